@@ -19,71 +19,40 @@
 
 /* Motorola 6809 microprocessor emulation */
 
+#include "6809cpu.h"
+
 //pointeurs vers fonctions d'acces memoire
 char (*Mgetc)(unsigned short a);
 void (*Mputc)(unsigned short a, char c);
 
-//global variables
-static int dc6809_cycles; //additional cycles
-static int dc6809_sync;   //synchronisation flag
-int dc6809_irq;    //irq trigger  (0=inactif)
-static int dc6809_firq;   //firq trigger (0=inactif)
-static int dc6809_nmi;    //nmi trigger  (0=inactif)
-static short dc6809_w;    //dc6809 work register
-
-//6809 registers
-char  dc6809_cc;   //condition code
-unsigned short dc6809_pc; //program counter
-static short dc6809_d;    //D register
-short dc6809_x;    //X register
-short dc6809_y;    //Y register
-short dc6809_u;    //U register
-short dc6809_s;    //S register
-static short dc6809_da;   //direct address (DP register = high byte of direct address)
-
-//pointers to register bytes
-char *dc6809_a;    //pointer to A register
-char *dc6809_b;    //pointer to B register
-char *dc6809_dp;   //pointer to DP register
-static char *dc6809_dd;   //pointer to direct address low byte
-static char *dc6809_pch;  //pointer to PC low byte
-static char *dc6809_pcl;  //pointer to PC high byte
-static char *dc6809_xh;   //pointer to X low byte
-static char *dc6809_xl;   //pointer to X high byte
-static char *dc6809_yh;   //pointer to Y low byte
-static char *dc6809_yl;   //pointer to Y high byte
-static char *dc6809_uh;   //pointer to U low byte
-static char *dc6809_ul;   //pointer to U high byte
-static char *dc6809_sh;   //pointer to S low byte
-static char *dc6809_sl;   //pointer to S high byte
+//6809 state
+Cpu6809 dc6809;
 
 //aliases
-#define AP   dc6809_a
-#define BP   dc6809_b
-#define N    dc6809_cycles
-#define CC   dc6809_cc
-#define PC   dc6809_pc
-#define PCH *dc6809_pch
-#define PCL *dc6809_pcl
-#define DA   dc6809_da
-#define DP  *dc6809_dp
-#define DD  *dc6809_dd
-#define D    dc6809_d
-#define A   *dc6809_a
-#define B   *dc6809_b
-#define X    dc6809_x
-#define XH  *dc6809_xh
-#define XL  *dc6809_xl
-#define Y    dc6809_y
-#define YH  *dc6809_yh
-#define YL  *dc6809_yl
-#define U    dc6809_u
-#define UH  *dc6809_uh
-#define UL  *dc6809_ul
-#define S    dc6809_s
-#define SH  *dc6809_sh
-#define SL  *dc6809_sl
-#define W    dc6809_w
+#define N    dc6809.cycles
+#define CC   dc6809.cc
+#define PC   dc6809.pc.uw
+#define PCH  dc6809.pc.b.h
+#define PCL  dc6809.pc.b.l
+#define DA   dc6809.da.w
+#define DP   dc6809.da.b.h
+#define DD   dc6809.da.b.l
+#define D    dc6809.d.w
+#define A    dc6809.d.b.h
+#define B    dc6809.d.b.l
+#define X    dc6809.x.w
+#define XH   dc6809.x.b.h
+#define XL   dc6809.x.b.l
+#define Y    dc6809.y.w
+#define YH   dc6809.y.b.h
+#define YL   dc6809.y.b.l
+#define U    dc6809.u.w
+#define UH   dc6809.u.b.h
+#define UL   dc6809.u.b.l
+#define S    dc6809.s.w
+#define SH   dc6809.s.b.h
+#define SL   dc6809.s.b.l
+#define W    dc6809.w.w
 
 /* memory access C = 1 byte, W = 2 bytes */
 #define GETC(x)   Mgetc(x)
@@ -113,53 +82,190 @@ N BL BMI     ZC BHI BLS     NV BGE BLT     001 no  yes
               01 no  yes     01 no  yes     011 no  no
               11 no  no      11 yes no      111 no  yes
  */
-#define CC_BCC (dc6809_cc&1)==0  // BCC = BHS
-#define CC_BCS (dc6809_cc&1)==1  // BCS = BLO
-#define CC_BVC (dc6809_cc&2)==0
-#define CC_BVS (dc6809_cc&2)==2
-#define CC_BNE (dc6809_cc&4)==0
-#define CC_BEQ (dc6809_cc&4)==4
-#define CC_BHI (dc6809_cc&5)==0
-#define CC_BLS (dc6809_cc&5)==4||(dc6809_cc&5)==1
-#define CC_BL  (dc6809_cc&8)==0
-#define CC_BMI (dc6809_cc&8)==8
-#define CC_BGE (dc6809_cc&10)==0||(dc6809_cc&10)==10
-#define CC_BLT (dc6809_cc&10)==8||(dc6809_cc&10)==2
-#define CC_BGT (dc6809_cc&14)==0||(dc6809_cc&14)==10
-#define CC_BLE (dc6809_cc&14)==8||(dc6809_cc&14)==14||(dc6809_cc&14)==4||(dc6809_cc&14)==2
-#define BRANCH {dc6809_pc+=GETC(dc6809_pc);}
-#define LBRANCH {dc6809_pc+=GETW(dc6809_pc);dc6809_cycles++;}
+//index = condition (low nibble of the branch opcode), NZVC bits of CC
+static const char branch_table[16][16] =
+{
+  {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1}, /* BRA */
+  {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}, /* BRN */
+  {1,0,1,0,0,0,0,0,1,0,1,0,0,0,0,0}, /* BHI */
+  {0,1,0,1,1,0,1,0,0,1,0,1,1,0,1,0}, /* BLS */
+  {1,0,1,0,1,0,1,0,1,0,1,0,1,0,1,0}, /* BCC */
+  {0,1,0,1,0,1,0,1,0,1,0,1,0,1,0,1}, /* BCS */
+  {1,1,1,1,0,0,0,0,1,1,1,1,0,0,0,0}, /* BNE */
+  {0,0,0,0,1,1,1,1,0,0,0,0,1,1,1,1}, /* BEQ */
+  {1,1,0,0,1,1,0,0,1,1,0,0,1,1,0,0}, /* BVC */
+  {0,0,1,1,0,0,1,1,0,0,1,1,0,0,1,1}, /* BVS */
+  {1,1,1,1,1,1,1,1,0,0,0,0,0,0,0,0}, /* BL  */
+  {0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1}, /* BMI */
+  {1,1,0,0,1,1,0,0,0,0,1,1,0,0,1,1}, /* BGE */
+  {0,0,1,1,0,0,1,1,1,1,0,0,1,1,0,0}, /* BLT */
+  {1,1,0,0,0,0,0,0,0,0,1,1,0,0,0,0}, /* BGT */
+  {0,0,1,1,1,1,0,0,1,1,0,0,0,0,1,1}  /* BLE */
+};
+#define CC_COND(n) branch_table[n][CC&0x0f]
+#define CC_BHI CC_COND(0x2)
+#define CC_BLS CC_COND(0x3)
+#define CC_BCC CC_COND(0x4)  // BCC = BHS
+#define CC_BCS CC_COND(0x5)  // BCS = BLO
+#define CC_BNE CC_COND(0x6)
+#define CC_BEQ CC_COND(0x7)
+#define CC_BVC CC_COND(0x8)
+#define CC_BVS CC_COND(0x9)
+#define CC_BL  CC_COND(0xa)
+#define CC_BMI CC_COND(0xb)
+#define CC_BGE CC_COND(0xc)
+#define CC_BLT CC_COND(0xd)
+#define CC_BGT CC_COND(0xe)
+#define CC_BLE CC_COND(0xf)
+#define BRANCH {PC+=GETC(PC);}
+#define LBRANCH {PC+=GETW(PC);N++;}
 
 //repetitive code
 #define INDIRECT Mgeti()
-#define DIRECT *dc6809_dd=GETC(dc6809_pc);dc6809_pc++
-#define EXTENDED dc6809_w=GETW(dc6809_pc);dc6809_pc+=2
-#define SET_Z if(dc6809_w)dc6809_cc&=0xfb;else dc6809_cc|=0x04
+#define DIRECT DD=GETC(PC);PC++
+#define EXTENDED W=GETW(PC);PC+=2
+#define SET_Z if(W)CC&=0xfb;else CC|=0x04
 
 // Fonctions d'acces memoire
 short Mgetw(unsigned short a) {return (Mgetc(a) << 8 | (Mgetc(a+1) & 0xff));}
 void Mputw(unsigned short a, short w) {Mputc(a, w >> 8); Mputc(++a, w);}
 
-// Processor initialisation //////////////////////////////////////////////////
+// Precomputed 8-bit ALU results ////////////////////////////////////////////
+//unary operations: result in the low byte, NZVC flags in the high byte
+static unsigned short neg_table[256];
+static unsigned short com_table[256];
+static unsigned short inc_table[256];
+static unsigned short dec_table[256];
+static unsigned short lsr_table[256];
+static unsigned short asr_table[256];
+static unsigned short asl_table[256];
+static unsigned short ror_table[512]; //index = carry << 8 | operand
+static unsigned short rol_table[512]; //index = carry << 8 | operand
+static unsigned short daa_table[1024]; //index = C << 9 | H << 8 | A
+//N and Z flags of an 8-bit result
+static unsigned char nz_table[256];
+//H, V and C flags of an addition/subtraction, indexed by bits 4 to 8 of
+//(operand1 ^ operand2 ^ result)
+static unsigned char add_flags_table[32];
+static unsigned char sub_flags_table[32];
+
+// Decoded indexed post-bytes, PSH/PUL masks and EXG/TFR post-bytes //////////
+//indexed addressing modes
+enum { IDX_OFFSET5, IDX_POSTINC1, IDX_POSTINC2, IDX_PREDEC1, IDX_PREDEC2,
+       IDX_NOOFFSET, IDX_B, IDX_A, IDX_OFFSET8, IDX_OFFSET16, IDX_D,
+       IDX_PCR8, IDX_PCR16, IDX_EXTENDED };
+typedef struct
+{
+  unsigned char reg;      //index register (0=X, 1=Y, 2=U, 3=S)
+  unsigned char mode;     //addressing mode (IDX_xxx)
+  unsigned char cycles;   //additional cycles
+  unsigned char indirect; //1=indirect addressing
+  signed char offset;     //5 bits offset (IDX_OFFSET5 only)
+} IndexedPostbyte;
+static IndexedPostbyte indexed_table[256];
+//mode and cycles for post-bytes 0x80-0x9f (bit 4 = indirect)
+//Assumes 0x84 for invalid bytes 0x87 0x8a 0x8e 0x8f
+//Assumes 0x94 for invalid bytes 0x90 0x92 0x97 0x9a 0x9e
+static const unsigned char indexed_modes[32][2] =
+{
+  {IDX_POSTINC1, 2}, {IDX_POSTINC2, 3}, {IDX_PREDEC1, 2}, {IDX_PREDEC2, 3}, // ,R+ ,R++ ,-R ,--R
+  {IDX_NOOFFSET, 0}, {IDX_B, 1},        {IDX_A, 1},       {IDX_NOOFFSET, 0}, // ,R B,R A,R invalid
+  {IDX_OFFSET8, 1},  {IDX_OFFSET16, 4}, {IDX_NOOFFSET, 0}, {IDX_D, 4},       // char,R word,R invalid D,R
+  {IDX_PCR8, 1},     {IDX_PCR16, 5},    {IDX_NOOFFSET, 0}, {IDX_NOOFFSET, 0}, // char,PCR word,PCR invalid
+  {IDX_NOOFFSET, 3}, {IDX_POSTINC2, 6}, {IDX_NOOFFSET, 3}, {IDX_PREDEC2, 6}, // invalid [,R++] invalid [,--R]
+  {IDX_NOOFFSET, 3}, {IDX_B, 4},        {IDX_A, 4},       {IDX_NOOFFSET, 3}, // [,R] [B,R] [A,R] invalid
+  {IDX_OFFSET8, 4},  {IDX_OFFSET16, 7}, {IDX_NOOFFSET, 3}, {IDX_D, 7},       // [char,R] [word,R] invalid [D,R]
+  {IDX_PCR8, 4},     {IDX_PCR16, 8},    {IDX_NOOFFSET, 3}, {IDX_EXTENDED, 5}  // [char,PCR] [word,PCR] invalid [word]
+};
+//index registers
+static short * const index_registers[4] = {&X, &Y, &U, &S};
+//additional cycles of PSH/PUL for each register mask
+static unsigned char stack_cycles[256];
+//EXG/TFR post-bytes: 0=invalid, 1=8-bit registers, 2=16-bit registers
+static unsigned char exg_table[256];
+//EXG/TFR registers (16-bit: 0=D 1=X 2=Y 3=U 4=S 5=PC, 8-bit: 8=A 9=B a=CC b=DP)
+static short * const exg_registers16[6] = {&D, &X, &Y, &U, &S, &dc6809.pc.w};
+static char * const exg_registers8[4] = {&A, &B, &CC, &DP};
+
+// Processor initialisation (precomputed tables) /////////////////////////////
 static void Init6809(void)
 {
-  int i = 1;              //integer used to test endianness
-  char *c = (char*)&i;    //left byte of integer i
-  //register pointer initialisation
-  dc6809_pch = dc6809_pcl = (char*)&dc6809_pc; //PC msb & lsb
-  dc6809_a = dc6809_b = (char*)&dc6809_d;      // D msb & lsb
-  dc6809_xh = dc6809_xl = (char*)&dc6809_x;    // X msb & lsb
-  dc6809_yh = dc6809_yl = (char*)&dc6809_y;    // Y msb & lsb
-  dc6809_uh = dc6809_ul = (char*)&dc6809_u;    // U msb & lsb
-  dc6809_sh = dc6809_sl = (char*)&dc6809_s;    // S msb & lsb
-  dc6809_dp = dc6809_dd = (char*)&dc6809_da;   //DP msb & lsb
-  //test endianness: 1=little-endian, 0=big-endian
-  switch(c[0])
+  static int initialized = 0;
+  int i, c, r, cc;
+  if(initialized) return;
+  initialized = 1;
+  for(i = 0; i < 256; i++)
+  {
+    nz_table[i] = ((i & 0x80) ? CC_N : 0) | ((i == 0) ? CC_Z : 0);
+  }
+  for(i = 0; i < 32; i++)
+  {
+    //bit 0 = carry into bit 4, bit 3 = carry into bit 7, bit 4 = carry out
+    c = (i >> 4) & 1;
+    add_flags_table[i] = ((i & 0x01) ? CC_H : 0) | (c ? CC_C : 0)
+                       | ((((i >> 3) & 1) ^ c) ? CC_V : 0);
+    sub_flags_table[i] = (c ? CC_C : 0) | ((((i >> 3) & 1) ^ c) ? CC_V : 0);
+  }
+  for(i = 0; i < 256; i++)
+  {
+    r = -i & 0xff;
+    neg_table[i] = r | (nz_table[r] | ((i == 0x80) ? CC_V : 0) | (r ? CC_C : 0)) << 8;
+    r = ~i & 0xff;
+    com_table[i] = r | (nz_table[r] | CC_C) << 8;
+    r = (i + 1) & 0xff;
+    inc_table[i] = r | (nz_table[r] | ((i == 0x7f) ? CC_V : 0)) << 8;
+    r = (i - 1) & 0xff;
+    dec_table[i] = r | (nz_table[r] | ((i == 0x80) ? CC_V : 0)) << 8;
+    r = i >> 1;
+    lsr_table[i] = r | ((r ? 0 : CC_Z) | (i & 1)) << 8;
+    r = (i >> 1) | (i & 0x80);
+    asr_table[i] = r | (nz_table[r] | (i & 1)) << 8;
+    r = (i << 1) & 0xff;
+    c = i >> 7;
+    asl_table[i] = r | (nz_table[r] | c | (((r >> 7) ^ c) ? CC_V : 0)) << 8;
+    for(cc = 0; cc < 2; cc++)
+    {
+      r = (i >> 1) | (cc << 7);
+      ror_table[cc << 8 | i] = r | (nz_table[r] | (i & 1)) << 8;
+      r = ((i << 1) & 0xff) | cc;
+      rol_table[cc << 8 | i] = r | (nz_table[r] | c | (((r >> 7) ^ c) ? CC_V : 0)) << 8;
+    }
+  }
+  for(i = 0; i < 1024; i++)
+  {
+    c = i & 0xff;
+    if((i & 0x100) || ((c & 0x00f) > 0x09)) c += 0x06;
+    if((i & 0x200) || ((c & 0x1f0) > 0x90)) c += 0x60;
+    r = c & 0xff;
+    //carry = carry out of the correction or previous carry
+    c = ((c >> 8) & 1) | ((i >> 9) & 1);
+    daa_table[i] = r | (nz_table[r] | c | (((r >> 7) ^ c) ? CC_V : 0)) << 8;
+  }
+  for(i = 0; i < 256; i++)
   {
-    case 1:  dc6809_xh++; dc6809_yh++; dc6809_uh++; dc6809_sh++;
-    dc6809_pch++; dc6809_dp++; dc6809_a++; break;
-    default: dc6809_xl++; dc6809_yl++; dc6809_ul++; dc6809_sl++;
-    dc6809_pcl++; dc6809_dd++; dc6809_b++; break;
+    indexed_table[i].reg = (i >> 5) & 3;
+    if(i & 0x80)
+    {
+      indexed_table[i].mode = indexed_modes[i & 0x1f][0];
+      indexed_table[i].cycles = indexed_modes[i & 0x1f][1];
+      indexed_table[i].indirect = (i & 0x10) ? 1 : 0;
+      indexed_table[i].offset = 0;
+    }
+    else
+    {
+      indexed_table[i].mode = IDX_OFFSET5;
+      indexed_table[i].cycles = 1;
+      indexed_table[i].indirect = 0;
+      indexed_table[i].offset = (i & 0x10) ? (i & 0x1f) - 0x20 : (i & 0x1f);
+    }
+    //PC, U/S, Y, X = 2 cycles, DP, B, A, CC = 1 cycle
+    stack_cycles[i] = 0;
+    for(c = 0; c < 8; c++) if(i & (1 << c)) stack_cycles[i] += (c < 4) ? 1 : 2;
+    //registers of the same size and different
+    r = i >> 4; c = i & 0x0f;
+    if((r < 6) && (c < 6) && (r != c)) exg_table[i] = 2;
+    else if((r >= 8) && (r < 12) && (c >= 8) && (c < 12) && (r != c)) exg_table[i] = 1;
+    else exg_table[i] = 0;
   }
 }
 
@@ -167,10 +273,8 @@ static void Init6809(void)
 void Reset6809(void)
 {
   Init6809();
-  dc6809_sync = 0;   //synchronisation flag
-  dc6809_irq = 0;    //irq trigger
-  dc6809_firq = 0;   //firq trigger
-  dc6809_nmi = 0;    //nmi trigger
+  dc6809.sync = 0;   //synchronisation flag
+  dc6809.interrupts = 0; //irq, firq & nmi triggers
   CC = 0x10;         //condition code
   PC = GETW(0xfffe); //program counter
 }
@@ -178,201 +282,102 @@ void Reset6809(void)
 // Get memory (indexed) //////////////////////////////////////////////////////
 static void Mgeti(void)
 {
-  int i;
-  short *r;
-  i = GETC(PC); PC++;
-  switch (i & 0x60)
+  const IndexedPostbyte *p = &indexed_table[GETC(PC) & 0xff];
+  short *r = index_registers[p->reg];
+  PC++;
+  N = p->cycles;
+  switch(p->mode)
   {
-    case 0x00: r = &X; break;
-    case 0x20: r = &Y; break;
-    case 0x40: r = &U; break;
-    case 0x60: r = &S; break;
-    default: r = &X;
-  }
-  switch(i &= 0x9f)
-  {
-    case 0x80: N = 2; W = *r; *r += 1; return;                    // ,R+
-    case 0x81: N = 3; W = *r; *r += 2; return;                    // ,R++
-    case 0x82: N = 2; *r -= 1; W = *r; return;                    // ,-R
-    case 0x83: N = 3; *r -= 2; W = *r; return;                    // ,--R
-    case 0x84: N = 0; W = *r; return;                             // ,R
-    case 0x85: N = 1; W = *r + B; return;                         // B,R
-    case 0x86: N = 1; W = *r + A; return;                         // A,R
-    case 0x87: N = 0; W = *r; return;                             // invalid
-    case 0x88: N = 1; W = *r + GETC(PC); PC++; return;            // char,R
-    case 0x89: N = 4; EXTENDED; W += *r; return;                  // word,R
-    case 0x8a: N = 0; W = *r; return;                             // invalid
-    case 0x8b: N = 4; W = *r + D; return;                         // D,R
-    case 0x8c: N = 1; W = GETC(PC); PC++; W += PC; return;        // char,PCR
-    case 0x8d: N = 5; EXTENDED; W += PC; return;                  // word,PCR
-    case 0x8e: N = 0; W = *r; return;                             // invalid
-    case 0x8f: N = 0; W = *r; return;                             // invalid
-    case 0x90: N = 3; W = GETW(*r); return;                       // invalid
-    case 0x91: N = 6; *r += 2; W = GETW(*r - 2); return;          // [,R++]
-    case 0x92: N = 3; W = GETW(*r); return;                       // invalid
-    case 0x93: N = 6; *r -= 2; W = GETW(*r); return;              // [,--R]
-    case 0x94: N = 3; W = GETW(*r); return;                       // [,R]
-    case 0x95: N = 4; W = GETW(*r + B); return;                   // [B,R]
-    case 0x96: N = 4; W = GETW(*r + A); return;                   // [A,R]
-    case 0x97: N = 3; W = GETW(*r); return;                       // invalid
-    case 0x98: N = 4; W = GETW(*r + GETC(PC)); PC++; return;      // [char,R]
-    case 0x99: N = 7; EXTENDED; W = GETW(*r + W); return;         // [word,R]
-    case 0x9a: N = 3; W = GETW(*r); return;                       // invalid
-    case 0x9b: N = 7; W = GETW(*r + D); return;                   // [D,R]
-    case 0x9c: N = 4; W = GETW(PC+1+GETC(PC)); PC++; return;      // [char,PCR]
-    case 0x9d: N = 8; EXTENDED; W = GETW(PC + W); return;         // [word,PCR]
-    case 0x9e: N = 3; W = GETW(*r); return;                       // invalid
-    case 0x9f: N = 5; EXTENDED; W = GETW(W); return;              // [word]
-    default  : N = 1; if(i & 0x10) i -= 0x20; W = *r + i; return; // 5 bits,R
-    //Assumes 0x84 for invalid bytes 0x87 0x8a 0x8e 0x8f
-    //Assumes 0x94 for invalid bytes 0x90 0x92 0x97 0x9a 0x9e
+    case IDX_OFFSET5:  W = *r + p->offset; return;          // 5 bits,R
+    case IDX_POSTINC1: W = *r; *r += 1; break;              // ,R+
+    case IDX_POSTINC2: W = *r; *r += 2; break;              // ,R++
+    case IDX_PREDEC1:  *r -= 1; W = *r; break;              // ,-R
+    case IDX_PREDEC2:  *r -= 2; W = *r; break;              // ,--R
+    case IDX_NOOFFSET: W = *r; break;                       // ,R
+    case IDX_B:        W = *r + B; break;                   // B,R
+    case IDX_A:        W = *r + A; break;                   // A,R
+    case IDX_OFFSET8:  W = *r + GETC(PC); PC++; break;      // char,R
+    case IDX_OFFSET16: EXTENDED; W += *r; break;            // word,R
+    case IDX_D:        W = *r + D; break;                   // D,R
+    case IDX_PCR8:     W = GETC(PC); PC++; W += PC; break;  // char,PCR
+    case IDX_PCR16:    EXTENDED; W += PC; break;            // word,PCR
+    case IDX_EXTENDED: EXTENDED; break;                     // [word]
   }
+  if(p->indirect) W = GETW(W);
 }
 
 // PSH, PUL, EXG, TFR /////////////////////////////////////////////////////////
 static void Pshs(char c)
 {
-  if(c & 0x80) {PUTC(--S,PCL); PUTC(--S,PCH); N += 2;}
-  if(c & 0x40) {PUTC(--S, UL); PUTC(--S, UH); N += 2;}
-  if(c & 0x20) {PUTC(--S, YL); PUTC(--S, YH); N += 2;}
-  if(c & 0x10) {PUTC(--S, XL); PUTC(--S, XH); N += 2;}
-  if(c & 0x08) {PUTC(--S, DP); N += 1;}
-  if(c & 0x04) {PUTC(--S,  B); N += 1;}
-  if(c & 0x02) {PUTC(--S,  A); N += 1;}
-  if(c & 0x01) {PUTC(--S, CC); N += 1;}
+  N += stack_cycles[c & 0xff];
+  if(c & 0x80) {PUTC(--S,PCL); PUTC(--S,PCH);}
+  if(c & 0x40) {PUTC(--S, UL); PUTC(--S, UH);}
+  if(c & 0x20) {PUTC(--S, YL); PUTC(--S, YH);}
+  if(c & 0x10) {PUTC(--S, XL); PUTC(--S, XH);}
+  if(c & 0x08) PUTC(--S, DP);
+  if(c & 0x04) PUTC(--S,  B);
+  if(c & 0x02) PUTC(--S,  A);
+  if(c & 0x01) PUTC(--S, CC);
 }
 
 static void Pshu(char c)
 {
-  if(c & 0x80) {PUTC(--U,PCL); PUTC(--U,PCH); N += 2;}
-  if(c & 0x40) {PUTC(--U, SL); PUTC(--U, SH); N += 2;}
-  if(c & 0x20) {PUTC(--U, YL); PUTC(--U, YH); N += 2;}
-  if(c & 0x10) {PUTC(--U, XL); PUTC(--U, XH); N += 2;}
-  if(c & 0x08) {PUTC(--U, DP); N += 1;}
-  if(c & 0x04) {PUTC(--U,  B); N += 1;}
-  if(c & 0x02) {PUTC(--U,  A); N += 1;}
-  if(c & 0x01) {PUTC(--U, CC); N += 1;}
+  N += stack_cycles[c & 0xff];
+  if(c & 0x80) {PUTC(--U,PCL); PUTC(--U,PCH);}
+  if(c & 0x40) {PUTC(--U, SL); PUTC(--U, SH);}
+  if(c & 0x20) {PUTC(--U, YL); PUTC(--U, YH);}
+  if(c & 0x10) {PUTC(--U, XL); PUTC(--U, XH);}
+  if(c & 0x08) PUTC(--U, DP);
+  if(c & 0x04) PUTC(--U,  B);
+  if(c & 0x02) PUTC(--U,  A);
+  if(c & 0x01) PUTC(--U, CC);
 }
 
 static void Puls(char c)
 {
-  if(c & 0x01) {CC = GETC(S); S++; N += 1;}
-  if(c & 0x02) { A = GETC(S); S++; N += 1;}
-  if(c & 0x04) { B = GETC(S); S++; N += 1;}
-  if(c & 0x08) {DP = GETC(S); S++; N += 1;}
-  if(c & 0x10) {XH = GETC(S); S++; XL = GETC(S); S++; N += 2;}
-  if(c & 0x20) {YH = GETC(S); S++; YL = GETC(S); S++; N += 2;}
-  if(c & 0x40) {UH = GETC(S); S++; UL = GETC(S); S++; N += 2;}
-  if(c & 0x80) {PCH= GETC(S); S++; PCL= GETC(S); S++; N += 2;}
+  N += stack_cycles[c & 0xff];
+  if(c & 0x01) {CC = GETC(S); S++;}
+  if(c & 0x02) { A = GETC(S); S++;}
+  if(c & 0x04) { B = GETC(S); S++;}
+  if(c & 0x08) {DP = GETC(S); S++;}
+  if(c & 0x10) {XH = GETC(S); S++; XL = GETC(S); S++;}
+  if(c & 0x20) {YH = GETC(S); S++; YL = GETC(S); S++;}
+  if(c & 0x40) {UH = GETC(S); S++; UL = GETC(S); S++;}
+  if(c & 0x80) {PCH= GETC(S); S++; PCL= GETC(S); S++;}
 }
 
 static void Pulu(char c)
 {
-  if(c & 0x01) {CC = GETC(U); U++; N += 1;}
-  if(c & 0x02) { A = GETC(U); U++; N += 1;}
-  if(c & 0x04) { B = GETC(U); U++; N += 1;}
-  if(c & 0x08) {DP = GETC(U); U++; N += 1;}
-  if(c & 0x10) {XH = GETC(U); U++; XL = GETC(U); U++; N += 2;}
-  if(c & 0x20) {YH = GETC(U); U++; YL = GETC(U); U++; N += 2;}
-  if(c & 0x40) {SH = GETC(U); U++; SL = GETC(U); U++; N += 2;}
-  if(c & 0x80) {PCH= GETC(U); U++; PCL= GETC(U); U++; N += 2;}
+  N += stack_cycles[c & 0xff];
+  if(c & 0x01) {CC = GETC(U); U++;}
+  if(c & 0x02) { A = GETC(U); U++;}
+  if(c & 0x04) { B = GETC(U); U++;}
+  if(c & 0x08) {DP = GETC(U); U++;}
+  if(c & 0x10) {XH = GETC(U); U++; XL = GETC(U); U++;}
+  if(c & 0x20) {YH = GETC(U); U++; YL = GETC(U); U++;}
+  if(c & 0x40) {SH = GETC(U); U++; SL = GETC(U); U++;}
+  if(c & 0x80) {PCH= GETC(U); U++; PCL= GETC(U); U++;}
 }
 
 static void Exg(char c)
 {
-  switch(c & 0xff)
+  int r1 = (c >> 4) & 0x0f, r2 = c & 0x0f;
+  switch(exg_table[c & 0xff])
   {
-    case 0x01: W = D; D = X; X = W; return;     //D-X
-    case 0x02: W = D; D = Y; Y = W; return;     //D-Y
-    case 0x03: W = D; D = U; U = W; return;     //D-U
-    case 0x04: W = D; D = S; S = W; return;     //D-S
-    case 0x05: W = D; D = PC; PC = W; return;   //D-PC
-    case 0x10: W = X; X = D; D = W; return;     //X-D
-    case 0x12: W = X; X = Y; Y = W; return;     //X-Y
-    case 0x13: W = X; X = U; U = W; return;     //X-U
-    case 0x14: W = X; X = S; S = W; return;     //X-S
-    case 0x15: W = X; X = PC; PC = W; return;   //X-PC
-    case 0x20: W = Y; Y = D; D = W; return;     //Y-D
-    case 0x21: W = Y; Y = X; X = W; return;     //Y-X
-    case 0x23: W = Y; Y = U; U = W; return;     //Y-U
-    case 0x24: W = Y; Y = S; S = W; return;     //Y-S
-    case 0x25: W = Y; Y = PC; PC = W; return;   //Y-PC
-    case 0x30: W = U; U = D; D = W; return;     //U-D
-    case 0x31: W = U; U = X; X = W; return;     //U-X
-    case 0x32: W = U; U = Y; Y = W; return;     //U-Y
-    case 0x34: W = U; U = S; S = W; return;     //U-S
-    case 0x35: W = U; U = PC; PC = W; return;   //U-PC
-    case 0x40: W = S; S = D; D = W; return;     //S-D
-    case 0x41: W = S; S = X; X = W; return;     //S-X
-    case 0x42: W = S; S = Y; Y = W; return;     //S-Y
-    case 0x43: W = S; S = U; U = W; return;     //S-U
-    case 0x45: W = S; S = PC; PC = W; return;   //S-PC
-    case 0x50: W = PC; PC = D; D = W; return;   //PC-D
-    case 0x51: W = PC; PC = X; X = W; return;   //PC-X
-    case 0x52: W = PC; PC = Y; Y = W; return;   //PC-Y
-    case 0x53: W = PC; PC = U; U = W; return;   //PC-U
-    case 0x54: W = PC; PC = S; S = W; return;   //PC-S
-    case 0x89: W = A; A = B; B = W; return;     //A-B
-    case 0x8a: W = A; A = CC; CC = W; return;   //A-CC
-    case 0x8b: W = A; A = DP; DP = W; return;   //A-DP
-    case 0x98: W = B; B = A; A = W; return;     //B-A
-    case 0x9a: W = B; B = CC; CC = W; return;   //B-CC
-    case 0x9b: W = B; B = DP; DP = W; return;   //B-DP
-    case 0xa8: W = CC; CC = A; A = W; return;   //CC-A
-    case 0xa9: W = CC; CC = B; B = W; return;   //CC-B
-    case 0xab: W = CC; CC = DP; DP = W; return; //CC-DP
-    case 0xb8: W = DP; DP = A; A = W; return;   //DP-A
-    case 0xb9: W = DP; DP = B; B = W; return;   //DP-B
-    case 0xba: W = DP; DP = CC; CC = W; return; //DP-CC
+    case 2: W = *exg_registers16[r1];
+      *exg_registers16[r1] = *exg_registers16[r2]; *exg_registers16[r2] = W; return;
+    case 1: W = *exg_registers8[r1 & 3];
+      *exg_registers8[r1 & 3] = *exg_registers8[r2 & 3]; *exg_registers8[r2 & 3] = W; return;
   }
 }
 
 static void Tfr(char c)
 {
-  switch(c & 0xff)
+  int r1 = (c >> 4) & 0x0f, r2 = c & 0x0f;
+  switch(exg_table[c & 0xff])
   {
-    case 0x01: X = D; return;
-    case 0x02: Y = D; return;
-    case 0x03: U = D; return;
-    case 0x04: S = D; return;
-    case 0x05: PC = D; return;
-    case 0x10: D = X; return;
-    case 0x12: Y = X; return;
-    case 0x13: U = X; return;
-    case 0x14: S = X; return;
-    case 0x15: PC = X; return;
-    case 0x20: D = Y; return;
-    case 0x21: X = Y; return;
-    case 0x23: U = Y; return;
-    case 0x24: S = Y; return;
-    case 0x25: PC = Y; return;
-    case 0x30: D = U; return;
-    case 0x31: X = U; return;
-    case 0x32: Y = U; return;
-    case 0x34: S = U; return;
-    case 0x35: PC = U; return;
-    case 0x40: D = S; return;
-    case 0x41: X = S; return;
-    case 0x42: Y = S; return;
-    case 0x43: U = S; return;
-    case 0x45: PC = S; return;
-    case 0x50: D = PC; return;
-    case 0x51: X = PC; return;
-    case 0x52: Y = PC; return;
-    case 0x53: U = PC; return;
-    case 0x54: S = PC; return;
-    case 0x89: B = A; return;
-    case 0x8a: CC = A; return;
-    case 0x8b: DP = A; return;
-    case 0x98: A = B; return;
-    case 0x9a: CC = B; return;
-    case 0x9b: DP = B; return;
-    case 0xa8: A = CC; return;
-    case 0xa9: B = CC; return;
-    case 0xab: DP = CC; return;
-    case 0xb8: A = DP; return;
-    case 0xb9: B = DP; return;
-    case 0xba: CC = DP; return;
+    case 2: *exg_registers16[r2] = *exg_registers16[r1]; return;
+    case 1: *exg_registers8[r2 & 3] = *exg_registers8[r1 & 3]; return;
   }
 }
 
@@ -386,43 +391,30 @@ static char Clr(void)
 
 static char Neg(char c)
 {
-  CC &= 0xf0;
-  if(c == -128) CC |= CC_V;
-  c = - c;
-  if(c != 0) CC |= CC_C;
-  if(c < 0) CC |= CC_N;
-  if(c == 0) CC |= CC_Z;
-  return c;
+  int r = neg_table[c & 0xff];
+  CC = (CC & 0xf0) | (r >> 8);
+  return r;
 }
 
 static char Com(char c)
 {
-  CC &= 0xf0;
-  c = ~c;
-  CC |= CC_C;
-  if(c < 0) CC |= CC_N;
-  if(c == 0) CC |= CC_Z;
-  return c;
+  int r = com_table[c & 0xff];
+  CC = (CC & 0xf0) | (r >> 8);
+  return r;
 }
 
 static char Inc(char c)
 {
-  CC &= 0xf1;
-  if(c == 127) CC |= CC_V;
-  c++;
-  if(c < 0) CC |= CC_N;
-  if(c == 0) CC |= CC_Z;
-  return c;
+  int r = inc_table[c & 0xff];
+  CC = (CC & 0xf1) | (r >> 8);
+  return r;
 }
 
 static char Dec(char c)
 {
-  CC &= 0xf1;
-  if(c == -128) CC |= CC_V;
-  c--;
-  if(c < 0) CC |= CC_N;
-  if(c == 0) CC |= CC_Z;
-  return c;
+  int r = dec_table[c & 0xff];
+  CC = (CC & 0xf1) | (r >> 8);
+  return r;
 }
 
 // Registers operations  (CC=EFHINZVC) ////////////////////////////////////////
@@ -436,27 +428,18 @@ static void Mul(void)
 
 static void Addc(char *r, char c)
 {
-  int i = *r + c;
-  CC &= 0xd0;
-  if(((*r & 0x0f) + (c & 0x0f)) & 0x10) CC |= CC_H;
-  if(((*r & 0xff) + (c & 0xff)) & 0x100) CC |= CC_C;
-  *r = i & 0xff;
-  if(*r != i) CC |= CC_V;
-  if(*r < 0) CC |= CC_N;
-  if(*r == 0) CC |= CC_Z;
+  int op1 = *r & 0xff, op2 = c & 0xff;
+  int i = op1 + op2;
+  *r = i;
+  CC = (CC & 0xd0) | add_flags_table[(op1 ^ op2 ^ i) >> 4 & 0x1f] | nz_table[i & 0xff];
 }
 
 static void Adc(char *r, char c)
 {
-  int carry = (CC & CC_C);
-  int i = *r + c + carry;
-  CC &= 0xd0;
-  if(((*r & 0x0f) + (c & 0x0f) + carry) & 0x10) CC |= CC_H;
-  if(((*r & 0xff) + (c & 0xff) + carry) & 0x100) CC |= CC_C;
-  *r = i & 0xff;
-  if(*r != i) CC |= CC_V;
-  if(*r < 0) CC |= CC_N;
-  if(*r == 0) CC |= CC_Z;
+  int op1 = *r & 0xff, op2 = c & 0xff;
+  int i = op1 + op2 + (CC & CC_C);
+  *r = i;
+  CC = (CC & 0xd0) | add_flags_table[(op1 ^ op2 ^ i) >> 4 & 0x1f] | nz_table[i & 0xff];
 }
 
 static void Addw(short *r, short word)
@@ -472,25 +455,18 @@ static void Addw(short *r, short word)
 
 static void Subc(char *r, char c)
 {
-  int i = *r - c;
-  CC &= 0xf0;
-  if(((*r & 0xff) - (c & 0xff)) & 0x100) CC |= CC_C;
-  *r = i & 0xff;
-  if(*r != i) CC |= CC_V;
-  if(*r < 0) CC |= CC_N;
-  if(*r == 0) CC |= CC_Z;
+  int op1 = *r & 0xff, op2 = c & 0xff;
+  int i = op1 - op2;
+  *r = i;
+  CC = (CC & 0xf0) | sub_flags_table[(op1 ^ op2 ^ i) >> 4 & 0x1f] | nz_table[i & 0xff];
 }
 
 static void Sbc(char *r, char c)
 {
-  int carry = (CC & CC_C);
-  int i = *r - c - carry;
-  CC &= 0xf0;
-  if(((*r & 0xff) - (c & 0xff) - carry) & 0x100) CC |= CC_C;
-  *r = i & 0xff;
-  if(*r != i) CC |= CC_V;
-  if(*r < 0) CC |= CC_N;
-  if(*r == 0) CC |= CC_Z;
+  int op1 = *r & 0xff, op2 = c & 0xff;
+  int i = op1 - op2 - (CC & CC_C);
+  *r = i;
+  CC = (CC & 0xf0) | sub_flags_table[(op1 ^ op2 ^ i) >> 4 & 0x1f] | nz_table[i & 0xff];
 }
 
 static void Subw(short *r, short word)
@@ -506,78 +482,51 @@ static void Subw(short *r, short word)
 
 static void Daa(void)
 {
-  int i = A & 0xff;
-  if((CC & CC_H) || ((i & 0x00f) > 0x09)) i += 0x06;
-  if((CC & CC_C) || ((i & 0x1f0) > 0x90)) i += 0x60;
-  A = i & 0xff;
-  i = (i >> 1 & 0xff) | (CC << 7);
-  CC &= 0xf0;
-  if(i & 0x80) CC |= CC_C;
-  if((A ^ i) & 0x80) CC |= CC_V;
-  if(A < 0) CC |= CC_N;
-  if(A == 0) CC |= CC_Z;
+  int r = daa_table[(CC & CC_C) << 9 | (CC & CC_H) << 3 | (A & 0xff)];
+  A = r;
+  CC = (CC & 0xf0) | (r >> 8);
 }
 
 // Shift and rotate  (CC=EFHINZVC) ////////////////////////////////////////////
 static char Lsr(char c)
 {
-  CC &= 0xf2;
-  if(c & 1) CC |= CC_C;
-  c = (c & 0xff) >> 1;
-  if(c == 0) CC |= CC_Z;
-  return c;
+  int r = lsr_table[c & 0xff];
+  CC = (CC & 0xf2) | (r >> 8);
+  return r;
 }
 
 static char Ror(char c)
 {
-  int carry = CC & CC_C;
-  CC &= 0xf2;
-  if(c & 1) CC |= CC_C;
-  c = ((c & 0xff) >> 1) | (carry << 7);
-  if(c < 0) CC |= CC_N;
-  if(c == 0) CC |= CC_Z;
-  return c;
+  int r = ror_table[(CC & CC_C) << 8 | (c & 0xff)];
+  CC = (CC & 0xf2) | (r >> 8);
+  return r;
 }
 
 static char Rol(char c)
 {
-  int carry = CC & CC_C;
-  CC &= 0xf0;
-  if(c < 0) CC |= CC_C;
-  c = ((c & 0x7f) << 1) | carry;
-  if((c >> 7 & 1) ^ (CC & CC_C)) CC |= CC_V;
-  if(c < 0) CC |= CC_N;
-  if(c == 0) CC |= CC_Z;
-  return c;
+  int r = rol_table[(CC & CC_C) << 8 | (c & 0xff)];
+  CC = (CC & 0xf0) | (r >> 8);
+  return r;
 }
 
 static char Asr(char c)
 {
-  CC &= 0xf2;
-  if(c & 1) CC |= CC_C;
-  c = ((c & 0xff) >> 1) | (c & 0x80);
-  if(c < 0) CC |= CC_N;
-  if(c == 0) CC |= CC_Z;
-  return c;
+  int r = asr_table[c & 0xff];
+  CC = (CC & 0xf2) | (r >> 8);
+  return r;
 }
 
 static char Asl(char c)
 {
-  CC &= 0xf0;
-  if(c < 0) CC |= CC_C;
-  c = (c & 0xff) << 1;
-  if((c >> 7 & 1) ^ (CC & CC_C)) CC |= CC_V;
-  if(c < 0) CC |= CC_N;
-  if(c == 0) CC |= CC_Z;
-  return c;
+  int r = asl_table[c & 0xff];
+  CC = (CC & 0xf0) | (r >> 8);
+  return r;
 }
 
 // Test and compare  (CC=EFHINZVC) ////////////////////////////////////////////
 static void Tstc(char c)
 {
-  CC &= 0xf1;
-  if(c < 0) CC |= CC_N;
-  if(c == 0) CC |= CC_Z;
+  CC = (CC & 0xf1) | nz_table[c & 0xff];
 }
 
 static void Tstw(short word)
@@ -589,14 +538,9 @@ static void Tstw(short word)
 
 static void Cmpc(char *reg, char c)
 {
-  char r = *reg;
-  int i = *reg - c;
-  CC &= 0xf0;
-  if(((r & 0xff) - (c & 0xff)) & 0x100) CC |= CC_C;
-  r = i & 0xff;
-  if(r != i) CC |= CC_V;
-  if(r < 0) CC |= CC_N;
-  if(r == 0) CC |= CC_Z;
+  int op1 = *reg & 0xff, op2 = c & 0xff;
+  int i = op1 - op2;
+  CC = (CC & 0xf0) | sub_flags_table[(op1 ^ op2 ^ i) >> 4 & 0x1f] | nz_table[i & 0xff];
 }
 
 static void Cmpw(short *reg, short word)
@@ -638,7 +582,7 @@ static int Firq(void) //fast interrupt request
 
 int Irq(void) //interrupt request
 {
-  if(dc6809_sync == 1) dc6809_sync = 2; //si attente synchro, indicateur d'interruption
+  if(dc6809.sync == 1) dc6809.sync = 2; //si attente synchro, indicateur d'interruption
   if((CC & CC_I) == 0)          //si les IRQs ne sont pas masquees
   {
     CC |= CC_E;
@@ -671,11 +615,11 @@ static void Rti(void)
 static void Sync(void)
 {
   //positionner le flag d'attente de synchronisation
-  if(dc6809_sync == 0) dc6809_sync = 1;
+  if(dc6809.sync == 0) dc6809.sync = 1;
   //boucle si aucune interruption n'a ete detectee
-  if(dc6809_sync != 2) PC--;
+  if(dc6809.sync != 2) PC--;
   //si interruption detectee: remise a zero du flag d'attente de synchronisation
-  if(dc6809_sync == 2) dc6809_sync = 0;
+  if(dc6809.sync == 2) dc6809.sync = 0;
 }
 
 // Execute one operation at pc address and set pc to next opcode address //////
@@ -690,9 +634,13 @@ int Run6809(void)
 
   N = 0; //initialisation du nombre de cycles additionnels
   precode = 0; //par defaut l'instruction n'a pas de precode
-  if(dc6809_nmi) if(Nmi()) return 7 + N;   //traitement NMI
-  if(dc6809_firq) if(Firq()) return 7 + N; //traitement FIRQ
-  if(dc6809_irq) if(Irq()) return 7 + N;   //traitement IRQ
+  //un seul test tant qu'aucune interruption n'est en attente
+  if(dc6809.interrupts)
+  {
+    if(dc6809.interrupts & INT_NMI) if(Nmi()) return 7 + N;   //traitement NMI
+    if(dc6809.interrupts & INT_FIRQ) if(Firq()) return 7 + N; //traitement FIRQ
+    if(dc6809.interrupts & INT_IRQ) if(Irq()) return 7 + N;   //traitement IRQ
+  }
 
   //lecture du code de l'instruction
   while(1)
@@ -829,132 +777,132 @@ int Run6809(void)
     case 0x7e: EXTENDED; PC = W; return 4;                      /* JMP  $  */
     case 0x7f: EXTENDED; PUTC(W, Clr()); return 7;              /* CLR  $  */
 
-    case 0x80: Subc(AP, GETC(PC)); PC++; return 2;              /* SUBA #$ */
-    case 0x81: Cmpc(AP, GETC(PC)); PC++; return 2;              /* CMPA #$ */
-    case 0x82: Sbc(AP, GETC(PC)); PC++; return 2;               /* SBCA #$ */
+    case 0x80: Subc(&A, GETC(PC)); PC++; return 2;              /* SUBA #$ */
+    case 0x81: Cmpc(&A, GETC(PC)); PC++; return 2;              /* CMPA #$ */
+    case 0x82: Sbc(&A, GETC(PC)); PC++; return 2;               /* SBCA #$ */
     case 0x83: EXTENDED; Subw(&D, W); return 4;                 /* SUBD #$ */
     case 0x84: Tstc(A &= GETC(PC)); PC++; return 2;             /* ANDA #$ */
     case 0x85: Tstc(A & GETC(PC)); PC++; return 2;              /* BITA #$ */
     case 0x86: Tstc(A = GETC(PC)); PC++; return 2;              /* LDA  #$ */
     case 0x88: Tstc(A ^= GETC(PC)); PC++; return 2;             /* EORA #$ */
-    case 0x89: Adc(AP, GETC(PC)); PC++; return 2;               /* ADCA #$ */
+    case 0x89: Adc(&A, GETC(PC)); PC++; return 2;               /* ADCA #$ */
     case 0x8a: Tstc(A |= GETC(PC)); PC++; return 2;             /* ORA  #$ */
-    case 0x8b: Addc(AP, GETC(PC)); PC++; return 2;              /* ADDA #$ */
+    case 0x8b: Addc(&A, GETC(PC)); PC++; return 2;              /* ADDA #$ */
     case 0x8c: EXTENDED; Cmpw(&X, W); return 4;                 /* CMPX #$ */
     case 0x8d: DIRECT; Pshs(0x80); PC += DD; return 7;          /* BSR     */
     case 0x8e: EXTENDED; Tstw(X = W); return 3;                 /* LDX  #$ */
 
-    case 0x90: DIRECT; Subc(AP, GETC(DA)); return 4;            /* SUBA /$ */
-    case 0x91: DIRECT; Cmpc(AP, GETC(DA)); return 4;            /* CMPA /$ */
-    case 0x92: DIRECT; Sbc(AP, GETC(DA)); return 4;             /* SBCA /$ */
+    case 0x90: DIRECT; Subc(&A, GETC(DA)); return 4;            /* SUBA /$ */
+    case 0x91: DIRECT; Cmpc(&A, GETC(DA)); return 4;            /* CMPA /$ */
+    case 0x92: DIRECT; Sbc(&A, GETC(DA)); return 4;             /* SBCA /$ */
     case 0x93: DIRECT; Subw(&D, GETW(DA));return 6;             /* SUBD /$ */
     case 0x94: DIRECT; Tstc(A &= GETC(DA)); return 4;           /* ANDA /$ */
     case 0x95: DIRECT; Tstc(A & GETC(DA)); return 4;            /* BITA /$ */
     case 0x96: DIRECT; Tstc(A = GETC(DA)); return 4;            /* LDA  /$ */
     case 0x97: DIRECT; PUTC(DA, A); Tstc(A); return 4;          /* STA  /$ */
     case 0x98: DIRECT; Tstc(A ^= GETC(DA)); return 4;           /* EORA /$ */
-    case 0x99: DIRECT; Adc(AP, GETC(DA)); return 4;             /* ADCA /$ */
+    case 0x99: DIRECT; Adc(&A, GETC(DA)); return 4;             /* ADCA /$ */
     case 0x9a: DIRECT; Tstc(A |= GETC(DA)); return 4;           /* ORA  /$ */
-    case 0x9b: DIRECT; Addc(AP, GETC(DA)); return 4;            /* ADDA /$ */
+    case 0x9b: DIRECT; Addc(&A, GETC(DA)); return 4;            /* ADDA /$ */
     case 0x9c: DIRECT; Cmpw(&X, GETW(DA)); return 6;            /* CMPX /$ */
     case 0x9d: DIRECT; Pshs(0x80); PC = DA; return 7;           /* JSR  /$ */
     case 0x9e: DIRECT; Tstw(X = GETW(DA)); return 5;            /* LDX  /$ */
     case 0x9f: DIRECT; PUTW(DA, X); Tstw(X); return 5;          /* STX  /$ */
 
-    case 0xa0: INDIRECT; Subc(AP, GETC(W)); return 4 + N;       /* SUBA IX */
-    case 0xa1: INDIRECT; Cmpc(AP, GETC(W)); return 4 + N;       /* CMPA IX */
-    case 0xa2: INDIRECT; Sbc(AP, GETC(W)); return 4 + N;        /* SBCA IX */
+    case 0xa0: INDIRECT; Subc(&A, GETC(W)); return 4 + N;       /* SUBA IX */
+    case 0xa1: INDIRECT; Cmpc(&A, GETC(W)); return 4 + N;       /* CMPA IX */
+    case 0xa2: INDIRECT; Sbc(&A, GETC(W)); return 4 + N;        /* SBCA IX */
     case 0xa3: INDIRECT; Subw(&D, GETW(W)); return 6 + N;       /* SUBD IX */
     case 0xa4: INDIRECT; Tstc(A &= GETC(W)); return 4 + N;      /* ANDA IX */
     case 0xa5: INDIRECT; Tstc(GETC(W) & A); return 4 + N;       /* BITA IX */
     case 0xa6: INDIRECT; Tstc(A = GETC(W)); return 4 + N;       /* LDA  IX */
     case 0xa7: INDIRECT; PUTC(W, A); Tstc(A); return 4 + N;     /* STA  IX */
     case 0xa8: INDIRECT; Tstc(A ^= GETC(W)); return 4 + N;      /* EORA IX */
-    case 0xa9: INDIRECT; Adc(AP, GETC(W)); return 4 + N;        /* ADCA IX */
+    case 0xa9: INDIRECT; Adc(&A, GETC(W)); return 4 + N;        /* ADCA IX */
     case 0xaa: INDIRECT; Tstc(A |= GETC(W)); return 4 + N;      /* ORA  IX */
-    case 0xab: INDIRECT; Addc(AP, GETC(W)); return 4 + N;       /* ADDA IX */
+    case 0xab: INDIRECT; Addc(&A, GETC(W)); return 4 + N;       /* ADDA IX */
     case 0xac: INDIRECT; Cmpw(&X, GETW(W)); return 4 + N;       /* CMPX IX */
     case 0xad: INDIRECT; Pshs(0x80); PC = W; return 5 + N;      /* JSR  IX */
     case 0xae: INDIRECT; Tstw(X = GETW(W)); return 5 + N;       /* LDX  IX */
     case 0xaf: INDIRECT; PUTW(W, X); Tstw(X); return 5 + N;     /* STX  IX */
 
-    case 0xb0: EXTENDED; Subc(AP, GETC(W)); return 5;           /* SUBA $  */
-    case 0xb1: EXTENDED; Cmpc(AP, GETC(W)); return 5;           /* CMPA $  */
-    case 0xb2: EXTENDED; Sbc(AP, GETC(W)); return 5;            /* SBCA $  */
+    case 0xb0: EXTENDED; Subc(&A, GETC(W)); return 5;           /* SUBA $  */
+    case 0xb1: EXTENDED; Cmpc(&A, GETC(W)); return 5;           /* CMPA $  */
+    case 0xb2: EXTENDED; Sbc(&A, GETC(W)); return 5;            /* SBCA $  */
     case 0xb3: EXTENDED; Subw(&D, GETW(W)); return 7;           /* SUBD $  */
     case 0xb4: EXTENDED; Tstc(A &= GETC(W)); return 5;          /* ANDA $  */
     case 0xb5: EXTENDED; Tstc(A & GETC(W)); return 5;           /* BITA $  */
     case 0xb6: EXTENDED; Tstc(A = GETC(W)); return 5;           /* LDA  $  */
     case 0xb7: EXTENDED; PUTC(W, A); Tstc(A); return 5;         /* STA  $  */
     case 0xb8: EXTENDED; Tstc(A ^= GETC(W)); return 5;          /* EORA $  */
-    case 0xb9: EXTENDED; Adc(AP, GETC(W)); return 5;            /* ADCA $  */
+    case 0xb9: EXTENDED; Adc(&A, GETC(W)); return 5;            /* ADCA $  */
     case 0xba: EXTENDED; Tstc(A |= GETC(W)); return 5;          /* ORA  $  */
-    case 0xbb: EXTENDED; Addc(AP, GETC(W)); return 5;           /* ADDA $  */
+    case 0xbb: EXTENDED; Addc(&A, GETC(W)); return 5;           /* ADDA $  */
     case 0xbc: EXTENDED; Cmpw(&X, GETW(W)); return 7;           /* CMPX $  */
     case 0xbd: EXTENDED; Pshs(0x80); PC = W; return 8;          /* JSR  $  */
     case 0xbe: EXTENDED; Tstw(X = GETW(W)); return 6;           /* LDX  $  */
     case 0xbf: EXTENDED; PUTW(W, X); Tstw(X); return 6;         /* STX  $  */
 
-    case 0xc0: Subc(BP, GETC(PC)); PC++; return 2;              /* SUBB #$ */
-    case 0xc1: Cmpc(BP, GETC(PC)); PC++; return 2;              /* CMPB #$ */
-    case 0xc2: Sbc(BP, GETC(PC)); PC++; return 2;               /* SBCB #$ */
+    case 0xc0: Subc(&B, GETC(PC)); PC++; return 2;              /* SUBB #$ */
+    case 0xc1: Cmpc(&B, GETC(PC)); PC++; return 2;              /* CMPB #$ */
+    case 0xc2: Sbc(&B, GETC(PC)); PC++; return 2;               /* SBCB #$ */
     case 0xc3: EXTENDED; Addw(&D, W); return 4;                 /* ADDD #$ */
     case 0xc4: Tstc(B &= GETC(PC)); PC++; return 2;             /* ANDB #$ */
     case 0xc5: Tstc(B & GETC(PC)); PC++; return 2;              /* BITB #$ */
     case 0xc6: Tstc(B = GETC(PC)); PC++; return 2;              /* LDB  #$ */
     case 0xc8: Tstc(B ^= GETC(PC)); PC++; return 2;             /* EORB #$ */
-    case 0xc9: Adc(BP, GETC(PC)); PC++; return 2;               /* ADCB #$ */
+    case 0xc9: Adc(&B, GETC(PC)); PC++; return 2;               /* ADCB #$ */
     case 0xca: Tstc(B |= GETC(PC)); PC++; return 2;             /* ORB  #$ */
-    case 0xcb: Addc(BP, GETC(PC)); PC++;return 2;               /* ADDB #$ */
+    case 0xcb: Addc(&B, GETC(PC)); PC++;return 2;               /* ADDB #$ */
     case 0xcc: EXTENDED; Tstw(D = W); return 3;                 /* LDD  #$ */
     case 0xce: EXTENDED; Tstw(U = W); return 3;                 /* LDU  #$ */
 
-    case 0xd0: DIRECT; Subc(BP, GETC(DA)); return 4;            /* SUBB /$ */
-    case 0xd1: DIRECT; Cmpc(BP, GETC(DA)); return 4;            /* CMPB /$ */
-    case 0xd2: DIRECT; Sbc(BP, GETC(DA)); return 4;             /* SBCB /$ */
+    case 0xd0: DIRECT; Subc(&B, GETC(DA)); return 4;            /* SUBB /$ */
+    case 0xd1: DIRECT; Cmpc(&B, GETC(DA)); return 4;            /* CMPB /$ */
+    case 0xd2: DIRECT; Sbc(&B, GETC(DA)); return 4;             /* SBCB /$ */
     case 0xd3: DIRECT; Addw(&D, GETW(DA)); return 6;            /* ADDD /$ */
     case 0xd4: DIRECT; Tstc(B &= GETC(DA)); return 4;           /* ANDB /$ */
     case 0xd5: DIRECT; Tstc(GETC(DA) & B); return 4;            /* BITB /$ */
     case 0xd6: DIRECT; Tstc(B = GETC(DA)); return 4;            /* LDB  /$ */
     case 0xd7: DIRECT; PUTC(DA,B); Tstc(B); return 4;           /* STB  /$ */
     case 0xd8: DIRECT; Tstc(B ^= GETC(DA)); return 4;           /* EORB /$ */
-    case 0xd9: DIRECT; Adc(BP, GETC(DA)); return 4;             /* ADCB /$ */
+    case 0xd9: DIRECT; Adc(&B, GETC(DA)); return 4;             /* ADCB /$ */
     case 0xda: DIRECT; Tstc(B |= GETC(DA)); return 4;           /* ORB  /$ */
-    case 0xdb: DIRECT; Addc(BP, GETC(DA)); return 4;            /* ADDB /$ */
+    case 0xdb: DIRECT; Addc(&B, GETC(DA)); return 4;            /* ADDB /$ */
     case 0xdc: DIRECT; Tstw(D = GETW(DA)); return 5;            /* LDD  /$ */
     case 0xdd: DIRECT; PUTW(DA, D); Tstw(D); return 5;          /* STD  /$ */
     case 0xde: DIRECT; Tstw(U = GETW(DA)); return 5;            /* LDU  /$ */
     case 0xdf: DIRECT; PUTW(DA, U); Tstw(U); return 5;          /* STU  /$ */
 
-    case 0xe0: INDIRECT; Subc(BP, GETC(W)); return 4 + N;       /* SUBB IX */
-    case 0xe1: INDIRECT; Cmpc(BP, GETC(W)); return 4 + N;       /* CMPB IX */
-    case 0xe2: INDIRECT; Sbc(BP, GETC(W)); return 4 + N;        /* SBCB IX */
+    case 0xe0: INDIRECT; Subc(&B, GETC(W)); return 4 + N;       /* SUBB IX */
+    case 0xe1: INDIRECT; Cmpc(&B, GETC(W)); return 4 + N;       /* CMPB IX */
+    case 0xe2: INDIRECT; Sbc(&B, GETC(W)); return 4 + N;        /* SBCB IX */
     case 0xe3: INDIRECT; Addw(&D, GETW(W)); return 6 + N;       /* ADDD IX */
     case 0xe4: INDIRECT; Tstc(B &= GETC(W)); return 4 + N;      /* ANDB IX */
     case 0xe5: INDIRECT; Tstc(B & GETC(W)); return 4 + N;       /* BITB IX */
     case 0xe6: INDIRECT; Tstc(B = GETC(W)); return 4 + N;       /* LDB  IX */
     case 0xe7: INDIRECT; PUTC(W, B); Tstc(B); return 4 + N;     /* STB  IX */
     case 0xe8: INDIRECT; Tstc(B ^= GETC(W)); return 4 + N;      /* EORB IX */
-    case 0xe9: INDIRECT; Adc(BP, GETC(W)); return 4 + N;        /* ADCB IX */
+    case 0xe9: INDIRECT; Adc(&B, GETC(W)); return 4 + N;        /* ADCB IX */
     case 0xea: INDIRECT; Tstc(B |= GETC(W)); return 4 + N;      /* ORB  IX */
-    case 0xeb: INDIRECT; Addc(BP, GETC(W)); return 4 + N;       /* ADDB IX */
+    case 0xeb: INDIRECT; Addc(&B, GETC(W)); return 4 + N;       /* ADDB IX */
     case 0xec: INDIRECT; Tstw(D = GETW(W)); return 5 + N;       /* LDD  IX */
     case 0xed: INDIRECT; PUTW(W, D); Tstw(D); return 5 + N;     /* STD  IX */
     case 0xee: INDIRECT; Tstw(U = GETW(W)); return 5 + N;       /* LDU  IX */
     case 0xef: INDIRECT; PUTW(W, U); Tstw(U); return 5 + N;     /* STU  IX */
 
-    case 0xf0: EXTENDED; Subc(BP, GETC(W)); return 5;           /* SUBB $  */
-    case 0xf1: EXTENDED; Cmpc(BP, GETC(W)); return 5;           /* CMPB $  */
-    case 0xf2: EXTENDED; Sbc(BP, GETC(W)); return 5;            /* SBCB $  */
+    case 0xf0: EXTENDED; Subc(&B, GETC(W)); return 5;           /* SUBB $  */
+    case 0xf1: EXTENDED; Cmpc(&B, GETC(W)); return 5;           /* CMPB $  */
+    case 0xf2: EXTENDED; Sbc(&B, GETC(W)); return 5;            /* SBCB $  */
     case 0xf3: EXTENDED; Addw(&D, GETW(W)); return 7;           /* ADDD $  */
     case 0xf4: EXTENDED; Tstc(B &= GETC(W)); return 5;          /* ANDB $  */
     case 0xf5: EXTENDED; Tstc(B & GETC(W)); return 5;           /* BITB $  */
     case 0xf6: EXTENDED; Tstc(B = GETC(W)); return 5;           /* LDB  $  */
     case 0xf7: EXTENDED; PUTC(W, B); Tstc(B); return 5;         /* STB  $  */
     case 0xf8: EXTENDED; Tstc(B ^= GETC(W)); return 5;          /* EORB $  */
-    case 0xf9: EXTENDED; Adc(BP, GETC(W)); return 5;            /* ADCB $  */
+    case 0xf9: EXTENDED; Adc(&B, GETC(W)); return 5;            /* ADCB $  */
     case 0xfa: EXTENDED; Tstc(B |= GETC(W)); return 5;          /* ORB  $  */
-    case 0xfb: EXTENDED; Addc(BP, GETC(W)); return 5;           /* ADDB $  */
+    case 0xfb: EXTENDED; Addc(&B, GETC(W)); return 5;           /* ADDB $  */
     case 0xfc: EXTENDED; Tstw(D = GETW(W)); return 6;           /* LDD  $  */
     case 0xfd: EXTENDED; PUTW(W, D); Tstw(D); return 6;         /* STD  $  */
     case 0xfe: EXTENDED; Tstw(U = GETW(W)); return 6;           /* LDU  $  */
@@ -1016,11 +964,11 @@ int Run6809(void)
 
 unsigned int cpu_serialize_size(void)
 {
-  return sizeof(dc6809_cycles) + sizeof(dc6809_sync) + sizeof(dc6809_irq)
-      + sizeof(dc6809_firq) + sizeof(dc6809_nmi) + sizeof(dc6809_w)
-      + sizeof(dc6809_cc) + sizeof(dc6809_pc) + sizeof(dc6809_d)
-      + sizeof(dc6809_x) + sizeof(dc6809_y) + sizeof(dc6809_u)
-      + sizeof(dc6809_s) + sizeof(dc6809_da);
+  // irq, firq and nmi are still saved as 3 separate ints
+  return sizeof(dc6809.cycles) + sizeof(dc6809.sync) + 3 * sizeof(int)
+      + sizeof(dc6809.w.w) + sizeof(dc6809.cc) + sizeof(dc6809.pc.uw) + sizeof(dc6809.d.w)
+      + sizeof(dc6809.x.w) + sizeof(dc6809.y.w) + sizeof(dc6809.u.w)
+      + sizeof(dc6809.s.w) + sizeof(dc6809.da.w);
 }
 
 #include <string.h>
@@ -1028,65 +976,70 @@ unsigned int cpu_serialize_size(void)
 void cpu_serialize(void *data)
 {
   int offset = 0;
+  int irq = (dc6809.interrupts & INT_IRQ) != 0;
+  int firq = (dc6809.interrupts & INT_FIRQ) != 0;
+  int nmi = (dc6809.interrupts & INT_NMI) != 0;
   char *buffer = (char *) data;
-  memcpy(buffer+offset, &dc6809_cycles, sizeof(dc6809_cycles));
-  offset += sizeof(dc6809_cycles);
-  memcpy(buffer+offset, &dc6809_sync, sizeof(dc6809_sync));
-  offset += sizeof(dc6809_sync);
-  memcpy(buffer+offset, &dc6809_irq, sizeof(dc6809_irq));
-  offset += sizeof(dc6809_irq);
-  memcpy(buffer+offset, &dc6809_firq, sizeof(dc6809_firq));
-  offset += sizeof(dc6809_firq);
-  memcpy(buffer+offset, &dc6809_nmi, sizeof(dc6809_nmi));
-  offset += sizeof(dc6809_nmi);
-  memcpy(buffer+offset, &dc6809_w, sizeof(dc6809_w));
-  offset += sizeof(dc6809_w);
-  memcpy(buffer+offset, &dc6809_cc, sizeof(dc6809_cc));
-  offset += sizeof(dc6809_cc);
-  memcpy(buffer+offset, &dc6809_pc, sizeof(dc6809_pc));
-  offset += sizeof(dc6809_pc);
-  memcpy(buffer+offset, &dc6809_d, sizeof(dc6809_d));
-  offset += sizeof(dc6809_d);
-  memcpy(buffer+offset, &dc6809_x, sizeof(dc6809_x));
-  offset += sizeof(dc6809_x);
-  memcpy(buffer+offset, &dc6809_y, sizeof(dc6809_y));
-  offset += sizeof(dc6809_y);
-  memcpy(buffer+offset, &dc6809_u, sizeof(dc6809_u));
-  offset += sizeof(dc6809_u);
-  memcpy(buffer+offset, &dc6809_s, sizeof(dc6809_s));
-  offset += sizeof(dc6809_s);
-  memcpy(buffer+offset, &dc6809_da, sizeof(dc6809_da));
+  memcpy(buffer+offset, &dc6809.cycles, sizeof(dc6809.cycles));
+  offset += sizeof(dc6809.cycles);
+  memcpy(buffer+offset, &dc6809.sync, sizeof(dc6809.sync));
+  offset += sizeof(dc6809.sync);
+  memcpy(buffer+offset, &irq, sizeof(irq));
+  offset += sizeof(irq);
+  memcpy(buffer+offset, &firq, sizeof(firq));
+  offset += sizeof(firq);
+  memcpy(buffer+offset, &nmi, sizeof(nmi));
+  offset += sizeof(nmi);
+  memcpy(buffer+offset, &dc6809.w.w, sizeof(dc6809.w.w));
+  offset += sizeof(dc6809.w.w);
+  memcpy(buffer+offset, &dc6809.cc, sizeof(dc6809.cc));
+  offset += sizeof(dc6809.cc);
+  memcpy(buffer+offset, &dc6809.pc.uw, sizeof(dc6809.pc.uw));
+  offset += sizeof(dc6809.pc.uw);
+  memcpy(buffer+offset, &dc6809.d.w, sizeof(dc6809.d.w));
+  offset += sizeof(dc6809.d.w);
+  memcpy(buffer+offset, &dc6809.x.w, sizeof(dc6809.x.w));
+  offset += sizeof(dc6809.x.w);
+  memcpy(buffer+offset, &dc6809.y.w, sizeof(dc6809.y.w));
+  offset += sizeof(dc6809.y.w);
+  memcpy(buffer+offset, &dc6809.u.w, sizeof(dc6809.u.w));
+  offset += sizeof(dc6809.u.w);
+  memcpy(buffer+offset, &dc6809.s.w, sizeof(dc6809.s.w));
+  offset += sizeof(dc6809.s.w);
+  memcpy(buffer+offset, &dc6809.da.w, sizeof(dc6809.da.w));
 }
 
 void cpu_unserialize(const void *data)
 {
   int offset = 0;
+  int irq, firq, nmi;
   const char *buffer = (const char *) data;
-  memcpy(&dc6809_cycles, buffer+offset, sizeof(dc6809_cycles));
-  offset += sizeof(dc6809_cycles);
-  memcpy(&dc6809_sync, buffer+offset, sizeof(dc6809_sync));
-  offset += sizeof(dc6809_sync);
-  memcpy(&dc6809_irq, buffer+offset, sizeof(dc6809_irq));
-  offset += sizeof(dc6809_irq);
-  memcpy(&dc6809_firq, buffer+offset, sizeof(dc6809_firq));
-  offset += sizeof(dc6809_firq);
-  memcpy(&dc6809_nmi, buffer+offset, sizeof(dc6809_nmi));
-  offset += sizeof(dc6809_nmi);
-  memcpy(&dc6809_w, buffer+offset, sizeof(dc6809_w));
-  offset += sizeof(dc6809_w);
-  memcpy(&dc6809_cc, buffer+offset, sizeof(dc6809_cc));
-  offset += sizeof(dc6809_cc);
-  memcpy(&dc6809_pc, buffer+offset, sizeof(dc6809_pc));
-  offset += sizeof(dc6809_pc);
-  memcpy(&dc6809_d, buffer+offset, sizeof(dc6809_d));
-  offset += sizeof(dc6809_d);
-  memcpy(&dc6809_x, buffer+offset, sizeof(dc6809_x));
-  offset += sizeof(dc6809_x);
-  memcpy(&dc6809_y, buffer+offset, sizeof(dc6809_y));
-  offset += sizeof(dc6809_y);
-  memcpy(&dc6809_u, buffer+offset, sizeof(dc6809_u));
-  offset += sizeof(dc6809_u);
-  memcpy(&dc6809_s, buffer+offset, sizeof(dc6809_s));
-  offset += sizeof(dc6809_s);
-  memcpy(&dc6809_da, buffer+offset, sizeof(dc6809_da));
+  memcpy(&dc6809.cycles, buffer+offset, sizeof(dc6809.cycles));
+  offset += sizeof(dc6809.cycles);
+  memcpy(&dc6809.sync, buffer+offset, sizeof(dc6809.sync));
+  offset += sizeof(dc6809.sync);
+  memcpy(&irq, buffer+offset, sizeof(irq));
+  offset += sizeof(irq);
+  memcpy(&firq, buffer+offset, sizeof(firq));
+  offset += sizeof(firq);
+  memcpy(&nmi, buffer+offset, sizeof(nmi));
+  offset += sizeof(nmi);
+  memcpy(&dc6809.w.w, buffer+offset, sizeof(dc6809.w.w));
+  offset += sizeof(dc6809.w.w);
+  memcpy(&dc6809.cc, buffer+offset, sizeof(dc6809.cc));
+  offset += sizeof(dc6809.cc);
+  memcpy(&dc6809.pc.uw, buffer+offset, sizeof(dc6809.pc.uw));
+  offset += sizeof(dc6809.pc.uw);
+  memcpy(&dc6809.d.w, buffer+offset, sizeof(dc6809.d.w));
+  offset += sizeof(dc6809.d.w);
+  memcpy(&dc6809.x.w, buffer+offset, sizeof(dc6809.x.w));
+  offset += sizeof(dc6809.x.w);
+  memcpy(&dc6809.y.w, buffer+offset, sizeof(dc6809.y.w));
+  offset += sizeof(dc6809.y.w);
+  memcpy(&dc6809.u.w, buffer+offset, sizeof(dc6809.u.w));
+  offset += sizeof(dc6809.u.w);
+  memcpy(&dc6809.s.w, buffer+offset, sizeof(dc6809.s.w));
+  offset += sizeof(dc6809.s.w);
+  memcpy(&dc6809.da.w, buffer+offset, sizeof(dc6809.da.w));
+  dc6809.interrupts = (irq ? INT_IRQ : 0) | (firq ? INT_FIRQ : 0) | (nmi ? INT_NMI : 0);
 }
@@ -31,29 +31,62 @@ extern short Mgetw(unsigned short a);
 // function to write 2 bytes at an address
 extern void Mputw(unsigned short a, short w);
 
-//6809 registers
-//condition code
-extern char  dc6809_cc;
-//X register
-extern short dc6809_x;
-//Y register
-extern short dc6809_y;
-//U register
-extern short dc6809_u;
-//S register
-extern short dc6809_s;
-//Program Counter
-extern unsigned short dc6809_pc;
+//host byte order (chosen at compile time)
+#if defined(MSB_FIRST) || defined(__BIG_ENDIAN__) \
+    || (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__))
+#define DC6809_BIG_ENDIAN
+#endif
+
+//cache line alignment of the CPU state
+#if defined(__GNUC__)
+#define DC6809_ALIGNED __attribute__((aligned(64)))
+#else
+#define DC6809_ALIGNED
+#endif
+
+//16-bit register, with access to its most and least significant bytes
+typedef union
+{
+  short w;
+  unsigned short uw;
+  struct
+  {
+#ifdef DC6809_BIG_ENDIAN
+    char h, l;
+#else
+    char l, h;
+#endif
+  } b;
+} Register6809;
 
-//pointer to A register
-extern char *dc6809_a;
-//pointer to B register
-extern char *dc6809_b;
-//pointer to DP register
-extern char *dc6809_dp;
+//6809 state
+typedef struct DC6809_ALIGNED
+{
+  Register6809 pc;  //program counter
+  Register6809 d;   //D register (A = msb, B = lsb)
+  Register6809 x;   //X register
+  Register6809 y;   //Y register
+  Register6809 u;   //U register
+  Register6809 s;   //S register
+  Register6809 da;  //direct address (DP register = msb)
+  Register6809 w;   //work register
+  char cc;          //condition code
+  int cycles;       //additional cycles
+  int sync;         //synchronisation flag
+  int interrupts;   //pending interrupts (combination of INT_xxx bits)
+} Cpu6809;
+
+//6809 registers
+//(e.g. dc6809.d.b.h = A register, dc6809.da.b.h = DP register)
+extern Cpu6809 dc6809;
 
-//irq trigger  (0=disabled, 1=enabled)
-extern int dc6809_irq;
+//interrupt lines (bits of dc6809.interrupts)
+#define INT_IRQ  0x01
+#define INT_FIRQ 0x02
+#define INT_NMI  0x04
+//dc6809.interrupts is tested as a single word by Run6809() before each
+//opcode fetch, so the devices must only update it when an interrupt line
+//actually changes.
 //interrupt request
 extern int Irq(void);
 
@@ -28,6 +28,7 @@
 
 static int n;          // number of cpu cycles
 static int pc;         // disassembling address
+static int mode;       // addressing mode of the instruction
 static char w[10];     // work area
 static char hexa[20];  // address and hexa dump
 static char param[20]; // parameters
@@ -411,7 +412,7 @@ static int instruction[0x300] =
     /*00aa*/ ORA   | IND  |  4,
     /*00ab*/ ADDA  | IND  |  4,
     /*00ac*/ CMPX  | IND  |  4,
-    /*00ad*/ JSR   | IND  |  5,
+    /*00ad*/ JSR   | IND  |  7,
     /*00ae*/ LDX   | IND  |  5,
     /*00af*/ STX   | IND  |  5,
 
@@ -1156,7 +1157,8 @@ int dasm6809(int address, char *string)
   if(code == 0x11) {precode = 0x200; i = Mgetc(pc) & 0xff;}
   if(precode > 0) if((i != 0x10) && (i != 0x11)) {GETBYTE; code = precode | i;}
   // opcode decoding
-  switch(instruction[code] & 0xff00)
+  mode = instruction[code] & 0xff00;
+  switch(mode)
   {
     case INH:  param[0] = 0; break;
     case DIR:  GETBYTE; sprintf(param, "/$%02X", i); break;
@@ -1179,3 +1181,29 @@ int dasm6809(int address, char *string)
   // return address of next instruction
   return pc;
 }
+
+int dasm6809_cycles(void)
+{
+  return n;
+}
+
+const char *dasm6809_mode(void)
+{
+  switch(mode)
+  {
+    case INH:  return "inherent";
+    case DIR:  return "direct";
+    case IMM1:
+    case IMM2: return "immediate";
+    case REL1:
+    case REL2: return "relative";
+    case IND:  return "indexed";
+    case EXT:  return "extended";
+    case REG0:
+    case REG1:
+    case REG2:
+    case REG3:
+    case REG4: return "register";
+    default:   return "invalid";
+  }
+}
@@ -27,4 +27,12 @@
 // return the address of the next instruction.
 int dasm6809(int a, char *string);
 
+// Number of cpu cycles of the last disassembled instruction (0 = unknown).
+int dasm6809_cycles(void);
+
+// Addressing mode of the last disassembled instruction
+// ("inherent", "direct", "immediate", "relative", "indexed", "extended",
+// "register" or "invalid").
+const char *dasm6809_mode(void);
+
 #endif
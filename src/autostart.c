@@ -213,6 +213,11 @@ bool is_sap_file(const char *filename)
   return (strlen(filename) > 4 && streq_nocase(filename + strlen(filename) - 4, ".sap"));
 }
 
+bool is_m3u_file(const char *filename)
+{
+  return (strlen(filename) > 4 && streq_nocase(filename + strlen(filename) - 4, ".m3u"));
+}
+
 Media get_media_type(const char *filename)
 {
   if (strlen(filename) > 3 && streq_nocase(filename + strlen(filename) - 3, ".k7"))
@@ -259,24 +264,15 @@ static bool find_tape_pattern(char *buffer, int size_buffer, char *pattern, int
 }
 
 /* Returns true if the first file of the tape has a BAS extension, false otherwise. */
-static bool autodetect_tape_first_file_is_basic(const char *filename)
+static bool autodetect_tape_first_file_is_basic(const char *data, long size)
 {
-  FILE *file;
   char tape_buffer[SIZE_BUFFER_TAPE];
 
-  file = fopen(filename, "rb");
-  if (file == NULL)
-  {
-    LOG_ERROR("Cannot open file %s.\n", filename);
-    return false;
-  }
-  if (fread(tape_buffer, SIZE_BUFFER_TAPE, 1, file) != 1)
+  if (size < SIZE_BUFFER_TAPE)
   {
-    LOG_ERROR("Cannot read file %s.\n", filename);
-    fclose(file);
     return false;
   }
-  fclose(file);
+  memcpy(tape_buffer, data, SIZE_BUFFER_TAPE);
   return find_tape_pattern(tape_buffer, SIZE_BUFFER_TAPE, TAPE_BASIC_PATTERN1, TAPE_BASIC_PATTERN1_SIZE)
       || find_tape_pattern(tape_buffer, SIZE_BUFFER_TAPE, TAPE_BASIC_PATTERN2, TAPE_BASIC_PATTERN2_SIZE)
       || find_tape_pattern(tape_buffer, SIZE_BUFFER_TAPE, TAPE_BASIC_PATTERN3, TAPE_BASIC_PATTERN3_SIZE);
@@ -333,10 +329,10 @@ char *autodetect_model(const char *filename)
   return "";
 }
 
-void autostart_init(const char *filename)
+void autostart_init(const char *filename, const char *data, long size)
 {
   currentMedia = get_media_type(filename);
-  program_is_basic = autodetect_tape_first_file_is_basic(filename);
+  program_is_basic = autodetect_tape_first_file_is_basic(data, size);
   current_autostart_key_pos = -1;
 }
 
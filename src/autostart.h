@@ -30,13 +30,15 @@ typedef enum { NO_MEDIA, MEDIA_FLOPPY, MEDIA_TAPE, MEDIA_CARTRIDGE } Media;
 Media get_media_type(const char *filename);
 /** Returns true if the given filename is an SAP file. */
 bool is_sap_file(const char *filename);
+/** Returns true if the given filename is an M3U playlist (set of floppy disks). */
+bool is_m3u_file(const char *filename);
 /* Returns the name of the Thomson model found in the name of the file,
    or an empty string if not found. */
 char *autodetect_model(const char *filename);
 
-/* Initialise the autostart feature.
+/* Initialise the autostart feature from the name and the content of the file.
  * This function must be called when a file/game is loaded. */
-void autostart_init(const char *filename);
+void autostart_init(const char *filename, const char *data, long size);
 /* This function must be called once per call of input_poll_cb() until it returns false
  * to simulate the keystrokes needed to start the currently loaded media. */
 bool autostart_nextkey();
@@ -0,0 +1,275 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Benchmark suite of the headless runner.
+ * Each workload is set up (not measured) then run for a fixed number of
+ * frames, so that the results only depend on the emulator's code. */
+
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libretro-common/include/libretro.h"
+#include "6809cpu.h"
+#include "devices.h"
+#include "keymap.h"
+#include "motoemulator.h"
+#include "video.h"
+
+#ifdef GIT_VERSION
+#define BENCH_VERSION GIT_VERSION
+#else
+#define BENCH_VERSION "unknown"
+#endif
+
+// Address of the synthetic programs (user RAM on all models)
+#define PROGRAM_ADDRESS 0x9000
+// Base address of the page 0 of the TO monitor (DK.xxx floppy registers)
+#define MONITOR_PAGE_0_TO 0x6000
+
+// Size of the media of the I/O workloads (loaded from memory, no file is written)
+#define BENCH_TAPE_SIZE   0x10000
+#define BENCH_FLOPPY_SIZE (80 * 16 * 256)
+
+typedef enum { WORKLOAD_BOOT, WORKLOAD_BASIC, WORKLOAD_VIDEO,
+               WORKLOAD_TAPE, WORKLOAD_FLOPPY } WorkloadType;
+
+typedef struct
+{
+  const char *name;
+  WorkloadType type;
+  const char *model;
+  int param;   // RETROK code of the BASIC key (boot) or VideoMode (video)
+  int frames;  // number of measured frames
+} Workload;
+
+static const Workload workloads[] =
+{
+  // Cold boot to the BASIC prompt
+  { "boot-TO8",    WORKLOAD_BOOT, "TO8",    RETROK_b, 250 },
+  { "boot-TO8D",   WORKLOAD_BOOT, "TO8D",   RETROK_b, 250 },
+  { "boot-TO9",    WORKLOAD_BOOT, "TO9",    RETROK_d, 250 },
+  { "boot-TO9+",   WORKLOAD_BOOT, "TO9+",   RETROK_b, 250 },
+  { "boot-MO5",    WORKLOAD_BOOT, "MO5",    0,        250 },
+  { "boot-MO6",    WORKLOAD_BOOT, "MO6",    RETROK_2, 250 },
+  { "boot-PC128",  WORKLOAD_BOOT, "PC128",  RETROK_2, 250 },
+  { "boot-TO7",    WORKLOAD_BOOT, "TO7",    RETROK_1, 250 },
+  { "boot-TO7/70", WORKLOAD_BOOT, "TO7/70", RETROK_1, 250 },
+  // BASIC arithmetic loop
+  { "basic-loop",  WORKLOAD_BASIC, "TO8", RETROK_b, 500 },
+  // Full screen redraw in each video mode (CPU idle)
+  { "video-320x16",         WORKLOAD_VIDEO, "TO8", VIDEO_320X16,        250 },
+  { "video-320x4",          WORKLOAD_VIDEO, "TO8", VIDEO_320X4,         250 },
+  { "video-320x4-special",  WORKLOAD_VIDEO, "TO8", VIDEO_320X4_SPECIAL, 250 },
+  { "video-160x16",         WORKLOAD_VIDEO, "TO8", VIDEO_160X16,        250 },
+  { "video-640x2",          WORKLOAD_VIDEO, "TO8", VIDEO_640X2,         250 },
+  { "video-320x16-mo5",     WORKLOAD_VIDEO, "MO5", VIDEO_320_16_MO5,    250 },
+  // Tape streaming (ReadBitTape) and floppy sector reads (Readsector)
+  { "tape-stream",  WORKLOAD_TAPE,   "TO8", 0, 500 },
+  { "floppy-read",  WORKLOAD_FLOPPY, "TO8", 0, 500 }
+};
+
+#define NB_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+// Boot time before the BASIC key is pressed (in frames)
+#define BOOT_FRAMES 100
+
+// Synthetic programs (the I/O opcodes are the ones of the patched ROMs)
+// loop: read a tape bit; bra loop
+static const unsigned char tape_program[] = { 0x41, 0x20, 0xfd };
+// loop: read a sector; inc DK.SEC; lda DK.SEC; cmpa #17; bne loop;
+//       lda #1; sta DK.SEC; bra loop
+static const unsigned char floppy_program[] =
+{ 0x14, 0x7c, 0x60, 0x4c, 0xb6, 0x60, 0x4c, 0x81, 0x11, 0x26, 0xf5,
+  0x86, 0x01, 0xb7, 0x60, 0x4c, 0x20, 0xee };
+// loop: bra loop
+static const unsigned char idle_program[] = { 0x20, 0xfe };
+
+// Text typed on the TO8's AZERTY keyboard (digits and + need SHIFT)
+static const char basic_loop_text[] = "FOR I=1 TO 30000:J=I*I+J:NEXT\r";
+
+static unsigned int random_seed = 1;
+
+static int next_random(void)
+{
+  random_seed = random_seed * 1103515245 + 12345;
+  return (random_seed >> 16) & 0xff;
+}
+
+static void run_frames(int n)
+{
+  while (n-- > 0) retro_run();
+}
+
+static void press_key(int retrokey, bool shift)
+{
+  int scancode = libretroKeyCodeToThomsonScanCode[retrokey];
+  int shiftcode = libretroKeyCodeToThomsonScanCode[RETROK_LSHIFT];
+  if (shift) keyboard(shiftcode, true);
+  keyboard(scancode, true);
+  run_frames(3);
+  keyboard(scancode, false);
+  if (shift) keyboard(shiftcode, false);
+  run_frames(3);
+}
+
+// Cold boot of the model, with the keyboard layout of the model
+// (the game is unloaded by cleanup())
+static void cold_boot(const char *model)
+{
+  cli_set_model(model);
+  retro_load_game(NULL);
+  retro_reset();
+}
+
+// Runs a synthetic program with the interrupts masked
+static void start_program(const unsigned char *program, int size)
+{
+  int i;
+  for (i = 0; i < size; i++) Mputc(PROGRAM_ADDRESS + i, program[i]);
+  dc6809.pc.uw = PROGRAM_ADDRESS;
+  dc6809.cc |= 0x50;
+}
+
+// Random content of a media (allocated with malloc)
+static char *create_media(int size)
+{
+  int i;
+  char *data = malloc(size);
+  if (data == NULL) return NULL;
+  for (i = 0; i < size; i++) data[i] = next_random();
+  return data;
+}
+
+// Setup of a workload (not measured)
+static bool setup(const Workload *w)
+{
+  const char *p;
+  char *data;
+  int i;
+  random_seed = 1;
+  cold_boot(w->model);
+  switch (w->type)
+  {
+    case WORKLOAD_BOOT:
+      // The BASIC key is pressed during the measure
+      return true;
+    case WORKLOAD_BASIC:
+      run_frames(BOOT_FRAMES);
+      press_key(w->param, false);
+      run_frames(BOOT_FRAMES);
+      for (p = basic_loop_text; *p; p++)
+      {
+        if ((*p >= 'A') && (*p <= 'Z')) press_key(RETROK_a + *p - 'A', false);
+        else if ((*p >= '0') && (*p <= '9')) press_key(RETROK_0 + *p - '0', true);
+        else if (*p == '+') press_key(RETROK_EQUALS, true);
+        else press_key(*p, false);
+      }
+      return true;
+    case WORKLOAD_VIDEO:
+      run_frames(BOOT_FRAMES);
+      // Random content in the 2 video pages (color and shape)
+      for (i = 0; i < 0x4000; i++) ram[i] = next_random();
+      start_program(idle_program, sizeof(idle_program));
+      SetVideoMode(w->param);
+      return true;
+    case WORKLOAD_TAPE:
+      run_frames(BOOT_FRAMES);
+      if ((data = create_media(BENCH_TAPE_SIZE)) == NULL) return false;
+      LoadTapeFromArray(NULL, data, BENCH_TAPE_SIZE);
+      free(data);
+      start_program(tape_program, sizeof(tape_program));
+      return true;
+    case WORKLOAD_FLOPPY:
+      run_frames(BOOT_FRAMES);
+      if ((data = create_media(BENCH_FLOPPY_SIZE)) == NULL) return false;
+      LoadFdFromArray(NULL, data, BENCH_FLOPPY_SIZE);
+      free(data);
+      Mputc(MONITOR_PAGE_0_TO + 0x49, 0);    // DK.DRV
+      Mputc(MONITOR_PAGE_0_TO + 0x4a, 0);    // DK.TRK (msb)
+      Mputc(MONITOR_PAGE_0_TO + 0x4b, 20);   // DK.TRK (lsb)
+      Mputc(MONITOR_PAGE_0_TO + 0x4c, 1);    // DK.SEC
+      Mputc(MONITOR_PAGE_0_TO + 0x4f, 0x91); // DK.BUF (msb)
+      Mputc(MONITOR_PAGE_0_TO + 0x50, 0x00); // DK.BUF (lsb)
+      start_program(floppy_program, sizeof(floppy_program));
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Unloads the game (and the media) loaded by setup()
+static void cleanup(void)
+{
+  retro_unload_game();
+}
+
+int run_benchmarks(const char *prefix)
+{
+  unsigned int i;
+  int n = 0;
+  clock_t start;
+  double seconds, cycles;
+  double instructions;
+
+  printf("{\n  \"version\": \"%s\",\n  \"benchmarks\": [", BENCH_VERSION);
+  for (i = 0; i < NB_WORKLOADS; i++)
+  {
+    const Workload *w = &workloads[i];
+    if ((prefix != NULL) && (strncmp(w->name, prefix, strlen(prefix)) != 0)) continue;
+    if (!setup(w))
+    {
+      fprintf(stderr, "Setup of workload %s failed.\n", w->name);
+      cleanup();
+      continue;
+    }
+
+    memset(&perfcounters, 0, sizeof(perfcounters));
+    start = clock();
+    if (w->type == WORKLOAD_BOOT)
+    {
+      run_frames(BOOT_FRAMES);
+      if (w->param != 0) press_key(w->param, false);
+      run_frames(w->frames - BOOT_FRAMES - ((w->param != 0) ? 6 : 0));
+    }
+    else
+    {
+      run_frames(w->frames);
+    }
+    seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    instructions = (double) perfcounters.instructions;
+    cycles = (double) perfcounters.cycles;
+    if (seconds <= 0) seconds = 1.0 / CLOCKS_PER_SEC;
+    cleanup();
+
+    printf("%s\n    {\"name\": \"%s\", \"model\": \"%s\", \"frames\": %d, "
+           "\"instructions\": %.0f, \"cycles\": %.0f, \"seconds\": %.6f, "
+           "\"instructions_per_second\": %.0f, \"cycles_per_second\": %.0f, "
+           "\"ns_per_frame\": %.0f}",
+           (n > 0) ? "," : "", w->name, w->model, w->frames,
+           instructions, cycles, seconds,
+           instructions / seconds, cycles / seconds, seconds * 1e9 / w->frames);
+    fflush(stdout);
+    n++;
+  }
+  printf("\n  ]\n}\n");
+  return n;
+}
@@ -0,0 +1,42 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Benchmark suite of the headless runner */
+
+#ifndef __BENCHMARK_H
+#define __BENCHMARK_H
+
+#include "boolean.h"
+
+// Sets the Thomson model loaded by the headless runner (defined in theodore_cli.c)
+void cli_set_model(const char *name);
+
+// Runs the workloads whose name starts with the given prefix (NULL = all)
+// and prints the results as JSON on the standard output.
+// Returns the number of workloads run.
+int run_benchmarks(const char *prefix);
+
+// Runs every opcode of the 6809 core on a flat 64 KB RAM (defined in opcodes.c)
+// and prints the timings and digests as JSON on the standard output.
+// If reference is not NULL, the digests are compared with this file
+// (or written to it if write is true).
+// Returns the number of differences with the reference (-1 on error,
+// e.g. if the reference file does not exist).
+int run_opcode_benchmarks(const char *reference, bool write);
+
+#endif /* __BENCHMARK_H */
@@ -0,0 +1,376 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Opcode micro-benchmarks and conformance vectors of the 6809 core.
+ * Every opcode of the 3 pages (0x10 and 0x11 prefixes included) is run by
+ * Run6809() from a set of pseudo-random cpu states, with a flat 64 KB RAM
+ * instead of the memory map of the emulated model. The post-bytes of the
+ * indexed mode and the register masks of TFR, EXG, PSH and PUL are then
+ * enumerated from a few of these states.
+ * The final states (registers, flags, cycles and memory writes) are hashed
+ * into one digest per opcode, which is compared with a reference file
+ * (test/opcodes.ref, generated from the original interpreter). */
+
+#include "benchmark.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "6809cpu.h"
+#include "6809disasm.h"
+
+#ifdef GIT_VERSION
+#define BENCH_VERSION GIT_VERSION
+#else
+#define BENCH_VERSION "unknown"
+#endif
+
+// Number of cpu states per opcode
+#define NB_STATES 256
+// Number of cpu states per post-byte of the indexed and register modes
+#define NB_POSTBYTE_STATES 4
+// Number of runs of each state for the measure
+#define NB_ROUNDS 40
+// Maximum number of writes of an instruction (12 for PSHS/PSHU/SWI)
+#define JOURNAL_SIZE 32
+// Size of the longest instruction (prefix, opcode, post-byte, 2 bytes offset)
+#define CODE_SIZE 5
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME  16777619u
+
+typedef struct
+{
+  int code;          // opcode (0x1xx = page 2, 0x2xx = page 3)
+  char mnemonic[8];
+  const char *mode;  // addressing mode (see dasm6809_mode())
+  int cyclesmin;     // minimum and maximum number of cycles returned by Run6809()
+  int cyclesmax;
+  int mismatches;    // number of states where Run6809() and dasm6809() disagree
+                     // (always the case for the long branches and RTI, whose 2
+                     // possible numbers of cycles are printed as 65 or 164)
+  double ns;         // time per instruction (harness overhead included)
+  unsigned int digest;
+} OpcodeResult;
+
+static const char *modes[] = { "inherent", "immediate", "direct", "indexed",
+                               "extended", "relative", "register" };
+#define NB_MODES (sizeof(modes) / sizeof(modes[0]))
+
+// Flat RAM and journal of the writes of the current instruction
+static char flatram[0x10000];
+static struct { unsigned short a; char old; char c; } journal[JOURNAL_SIZE];
+static int journalcount;
+
+static Cpu6809 states[NB_STATES];
+static unsigned int random_seed;
+
+static int next_random(void)
+{
+  random_seed = random_seed * 1103515245 + 12345;
+  return (random_seed >> 16) & 0xff;
+}
+
+static char FlatMgetc(unsigned short a)
+{
+  return flatram[a];
+}
+
+static void FlatMputc(unsigned short a, char c)
+{
+  if (journalcount < JOURNAL_SIZE)
+  {
+    journal[journalcount].a = a;
+    journal[journalcount].old = flatram[a];
+    journal[journalcount].c = c;
+    journalcount++;
+  }
+  flatram[a] = c;
+}
+
+static unsigned int hash(unsigned int h, unsigned int value)
+{
+  int i;
+  for (i = 0; i < 4; i++)
+  {
+    h = (h ^ (value & 0xff)) * FNV_PRIME;
+    value >>= 8;
+  }
+  return h;
+}
+
+// Random cpu states (the interrupts are never pending)
+static void init_states(void)
+{
+  int i;
+  random_seed = 1;
+  for (i = 0; i < 0x10000; i++) flatram[i] = next_random();
+  memset(states, 0, sizeof(states));
+  for (i = 0; i < NB_STATES; i++)
+  {
+    states[i].pc.uw = 0x0100 + ((next_random() << 8 | next_random()) % 0xfe00);
+    states[i].d.uw = next_random() << 8 | next_random();
+    states[i].x.uw = next_random() << 8 | next_random();
+    states[i].y.uw = next_random() << 8 | next_random();
+    states[i].u.uw = next_random() << 8 | next_random();
+    states[i].s.uw = next_random() << 8 | next_random();
+    states[i].da.uw = next_random() << 8;
+    states[i].cc = next_random();
+  }
+}
+
+// Writes the instruction at the address of the state and returns its size
+// (the following bytes are the random operands)
+static int write_code(int code, const Cpu6809 *state, char *saved)
+{
+  unsigned short pc = state->pc.uw;
+  int i, n = 0;
+  for (i = 0; i < CODE_SIZE; i++) saved[i] = flatram[(pc + i) & 0xffff];
+  if (code & 0x100) flatram[pc + n++] = 0x10;
+  if (code & 0x200) flatram[pc + n++] = 0x11;
+  flatram[pc + n++] = code & 0xff;
+  return n;
+}
+
+static void restore_code(const Cpu6809 *state, const char *saved)
+{
+  int i;
+  for (i = 0; i < CODE_SIZE; i++) flatram[(state->pc.uw + i) & 0xffff] = saved[i];
+}
+
+static void undo_writes(void)
+{
+  while (journalcount > 0)
+  {
+    journalcount--;
+    flatram[journal[journalcount].a] = journal[journalcount].old;
+  }
+}
+
+// Runs an opcode from a state, with the given post-byte (-1 to keep the
+// random operand), and adds the final state to the digest.
+// Returns the number of cycles (negative for an illegal opcode).
+static int run_state(OpcodeResult *r, const Cpu6809 *state, int postbyte, unsigned int *h)
+{
+  char saved[CODE_SIZE];
+  char string[64];
+  int j, cycles, n;
+
+  n = write_code(r->code, state, saved);
+  if (postbyte >= 0) flatram[state->pc.uw + n] = postbyte;
+  dasm6809(state->pc.uw, string);
+  if (r->mode == NULL)
+  {
+    sscanf(string, "%*s %*s %7s", r->mnemonic);
+    r->mode = dasm6809_mode();
+  }
+  dc6809 = *state;
+  cycles = Run6809();
+  if (cycles >= 0)
+  {
+    if (cycles < r->cyclesmin) r->cyclesmin = cycles;
+    if (cycles > r->cyclesmax) r->cyclesmax = cycles;
+    if (cycles != dasm6809_cycles()) r->mismatches++;
+    *h = hash(*h, cycles);
+    *h = hash(*h, dc6809.pc.uw);
+    *h = hash(*h, dc6809.d.uw);
+    *h = hash(*h, dc6809.x.uw);
+    *h = hash(*h, dc6809.y.uw);
+    *h = hash(*h, dc6809.u.uw);
+    *h = hash(*h, dc6809.s.uw);
+    *h = hash(*h, dc6809.da.b.h & 0xff);
+    *h = hash(*h, dc6809.cc & 0xff);
+    for (j = 0; j < journalcount; j++)
+      *h = hash(*h, journal[j].a << 8 | (journal[j].c & 0xff));
+  }
+  undo_writes();
+  restore_code(state, saved);
+  return cycles;
+}
+
+// Runs an opcode from all the states, then every post-byte (indexed mode) or
+// register mask (TFR, EXG, PSH and PUL) from the first NB_POSTBYTE_STATES
+// states, so that the rare post-bytes (indirect, extended indirect and
+// undefined modes) are always covered.
+// Returns false for an illegal opcode.
+static bool check_opcode(OpcodeResult *r)
+{
+  unsigned int h = FNV_OFFSET;
+  int i, postbyte;
+
+  r->cyclesmin = 1000;
+  r->cyclesmax = r->mismatches = 0;
+  r->mode = NULL;
+  for (i = 0; i < NB_STATES; i++)
+    if (run_state(r, &states[i], -1, &h) < 0) return false;
+  if ((strcmp(r->mode, "indexed") == 0) || (strcmp(r->mode, "register") == 0))
+    for (postbyte = 0; postbyte < 0x100; postbyte++)
+      for (i = 0; i < NB_POSTBYTE_STATES; i++)
+        run_state(r, &states[i], postbyte, &h);
+  r->digest = h;
+  return true;
+}
+
+// Time per instruction (in ns) with or without the execution of the instruction
+static double measure(int code, bool execute)
+{
+  char saved[CODE_SIZE];
+  clock_t start = clock();
+  int i, k;
+  for (k = 0; k < NB_ROUNDS; k++)
+    for (i = 0; i < NB_STATES; i++)
+    {
+      write_code(code, &states[i], saved);
+      dc6809 = states[i];
+      if (execute) Run6809();
+      undo_writes();
+      restore_code(&states[i], saved);
+    }
+  return (double) (clock() - start) * 1e9 / CLOCKS_PER_SEC / (NB_ROUNDS * NB_STATES);
+}
+
+// Writes the reference vectors.
+// Returns 0 (-1 if the file cannot be written).
+static int write_reference(const char *filename, const OpcodeResult *results, int n)
+{
+  FILE *fp = fopen(filename, "w");
+  int i;
+  if (fp == NULL)
+  {
+    fprintf(stderr, "Cannot write the reference vectors to %s.\n", filename);
+    return -1;
+  }
+  fprintf(fp, "# theodore %s - opcode digest cycles_min cycles_max\n", BENCH_VERSION);
+  for (i = 0; i < n; i++)
+    fprintf(fp, "%03x %08x %d %d\n", results[i].code, results[i].digest,
+            results[i].cyclesmin, results[i].cyclesmax);
+  fclose(fp);
+  fprintf(stderr, "Reference vectors written to %s.\n", filename);
+  return 0;
+}
+
+// Compares the results with the reference vectors.
+// Returns the number of differences (-1 if the file cannot be read).
+static int check_reference(const char *filename, const OpcodeResult *results, int n)
+{
+  FILE *fp = fopen(filename, "r");
+  char line[128];
+  unsigned int code, digest;
+  int i, cyclesmin, cyclesmax, errors = 0, found = 0;
+
+  if (fp == NULL)
+  {
+    fprintf(stderr, "Cannot read the reference vectors %s.\n", filename);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    if (sscanf(line, "%x %x %d %d", &code, &digest, &cyclesmin, &cyclesmax) != 4) continue;
+    for (i = 0; (i < n) && (results[i].code != (int) code); i++);
+    if (i == n)
+    {
+      fprintf(stderr, "Opcode %03x: missing\n", code);
+      errors++;
+      continue;
+    }
+    found++;
+    if ((results[i].digest != digest) || (results[i].cyclesmin != cyclesmin)
+        || (results[i].cyclesmax != cyclesmax))
+    {
+      fprintf(stderr, "Opcode %03x (%s): digest %08x cycles %d-%d, expected %08x cycles %d-%d\n",
+              code, results[i].mnemonic, results[i].digest, results[i].cyclesmin,
+              results[i].cyclesmax, digest, cyclesmin, cyclesmax);
+      errors++;
+    }
+  }
+  fclose(fp);
+  if (found != n)
+  {
+    fprintf(stderr, "%d opcodes are not in the reference vectors.\n", n - found);
+    errors += n - found;
+  }
+  fprintf(stderr, "%d opcodes checked, %d differences.\n", n, errors);
+  return errors;
+}
+
+int run_opcode_benchmarks(const char *reference, bool write)
+{
+  static OpcodeResult results[0x300];
+  char (*savedgetc)(unsigned short) = Mgetc;
+  void (*savedputc)(unsigned short, char) = Mputc;
+  Cpu6809 savedcpu = dc6809;
+  double overhead, ns[NB_MODES];
+  unsigned int m, digest = FNV_OFFSET;
+  int code, i, n = 0, count[NB_MODES];
+
+  Mgetc = FlatMgetc;
+  Mputc = FlatMputc;
+  journalcount = 0;
+  init_states();
+
+  for (code = 0; code < 0x300; code++)
+  {
+    // the prefixes are not opcodes of their own
+    if (((code & 0xff) == 0x10) || ((code & 0xff) == 0x11)) continue;
+    results[n].code = code;
+    if (!check_opcode(&results[n])) continue;
+    results[n].ns = measure(code, true);
+    digest = hash(digest, results[n].digest);
+    n++;
+  }
+  overhead = measure(0x12, false);
+
+  Mgetc = savedgetc;
+  Mputc = savedputc;
+  dc6809 = savedcpu;
+
+  printf("{\n  \"version\": \"%s\",\n  \"states\": %d,\n  \"overhead_ns\": %.1f,\n"
+         "  \"digest\": \"%08x\",\n  \"opcodes\": [", BENCH_VERSION, NB_STATES, overhead, digest);
+  for (i = 0; i < n; i++)
+  {
+    const OpcodeResult *r = &results[i];
+    printf("%s\n    {\"opcode\": \"%s%02X\", \"mnemonic\": \"%s\", \"mode\": \"%s\", "
+           "\"cycles_min\": %d, \"cycles_max\": %d, \"dasm_mismatches\": %d, "
+           "\"ns_per_instruction\": %.1f, \"digest\": \"%08x\"}",
+           (i > 0) ? "," : "", (r->code & 0x100) ? "10" : (r->code & 0x200) ? "11" : "",
+           r->code & 0xff, r->mnemonic, r->mode, r->cyclesmin, r->cyclesmax,
+           r->mismatches, r->ns, r->digest);
+  }
+  printf("\n  ],\n  \"modes\": [");
+  for (m = 0; m < NB_MODES; m++)
+  {
+    ns[m] = 0;
+    count[m] = 0;
+    for (i = 0; i < n; i++)
+      if (strcmp(results[i].mode, modes[m]) == 0)
+      {
+        ns[m] += results[i].ns;
+        count[m]++;
+      }
+    printf("%s\n    {\"mode\": \"%s\", \"opcodes\": %d, \"ns_per_instruction\": %.1f}",
+           (m > 0) ? "," : "", modes[m], count[m], (count[m] > 0) ? ns[m] / count[m] : 0);
+  }
+  printf("\n  ]\n}\n");
+  fflush(stdout);
+
+  if (reference == NULL) return 0;
+  return write ? write_reference(reference, results, n) : check_reference(reference, results, n);
+}
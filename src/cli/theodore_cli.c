@@ -0,0 +1,475 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Headless runner: drives the libretro core without any frontend
+ * (benchmarks and batch runs). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "libretro-common/include/libretro.h"
+#include "benchmark.h"
+#include "motoemulator.h"
+#include "video.h"
+
+#define VIDEO_FPS      50
+#define DEFAULT_FRAMES 3000
+#define MAX_EVENTS     4096
+
+// Scripted input event
+typedef enum { EVENT_KEY, EVENT_JOY } EventType;
+typedef struct
+{
+  long frame;      // frame before which the event is applied
+  EventType type;
+  int code;        // Thomson scancode or JoystickAxis
+  bool down;
+} Event;
+
+static const char *axis_names[] = { "JOY0_UP", "JOY0_DOWN", "JOY0_LEFT", "JOY0_RIGHT",
+                                    "JOY1_UP", "JOY1_DOWN", "JOY1_LEFT", "JOY1_RIGHT",
+                                    "JOY0_FIRE", "JOY1_FIRE" };
+
+// Options
+static const char *model = "Auto";
+static bool autorun = false;
+static bool verbose = false;
+static bool perf = false;
+static bool profile = false;
+static const char *trace = "disabled";
+static bool heatmap = false;
+static const char *gdbport = "disabled";
+static bool disassembler = false;
+static bool print_hashes = false;
+
+static Event events[MAX_EVENTS];
+static int nevents = 0;
+// Scripted state of the joysticks (forwarded to Joysemul() by the core)
+static bool joystick[JOY1_FIRE + 1];
+
+static const uint16_t *last_frame = NULL;
+static unsigned last_frame_pitch = 0;
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [options] [file.fd|file.sap|file.k7|file.m7|file.m5]\n", name);
+  fprintf(stderr, "  -m MODEL   Thomson model (Auto, TO8, TO8D, TO9, TO9+, MO5, MO6, PC128, TO7, TO7/70)\n");
+  fprintf(stderr, "  -f FRAMES  number of frames to run (default %d)\n", DEFAULT_FRAMES);
+  fprintf(stderr, "  -s SCRIPT  scripted input (lines: \"<frame> key <scancode> down|up\"\n");
+  fprintf(stderr, "             or \"<frame> joy <JOY0_UP|...|JOY1_FIRE> down|up\")\n");
+  fprintf(stderr, "  -a         start the program automatically (autorun)\n");
+  fprintf(stderr, "  -H         print the hashes of the last frame and of the RAM\n");
+  fprintf(stderr, "  -v         print the messages of the core\n");
+  fprintf(stderr, "  -p         log the performance counters of the core (every 250 frames)\n");
+  fprintf(stderr, "  -P         profile the emulated code (callgrind, folded stacks and listing\n");
+  fprintf(stderr, "             written in the current directory)\n");
+  fprintf(stderr, "  -T N       trace the last N instructions (theodore-trace.bin written\n");
+  fprintf(stderr, "             in the current directory, decoded by theodore-trace)\n");
+  fprintf(stderr, "  -M         count the accesses to each page of the memory (heatmap table\n");
+  fprintf(stderr, "             and image written in the current directory)\n");
+  fprintf(stderr, "  -g PORT    wait for a GDB client on the TCP port PORT of the local host\n");
+  fprintf(stderr, "  -d         start the interactive debugger (commands read from the standard input)\n");
+  fprintf(stderr, "  -b         run the benchmark suite (JSON output)\n");
+  fprintf(stderr, "  -w PREFIX  only run the benchmarks whose name starts with PREFIX\n");
+  fprintf(stderr, "  -o         run the opcode micro-benchmarks of the 6809 core (JSON output)\n");
+  fprintf(stderr, "  -O FILE    same as -o, and check the opcodes against the reference\n");
+  fprintf(stderr, "             vectors of FILE (e.g. test/opcodes.ref)\n");
+  fprintf(stderr, "  -W FILE    same as -o, and write the reference vectors to FILE\n");
+}
+
+void cli_set_model(const char *name)
+{
+  model = name;
+}
+
+// Libretro callbacks ////////////////////////////////////////////////////////
+static void log_printf(enum retro_log_level level, const char *fmt, ...)
+{
+  va_list args;
+  if (!verbose && (level < RETRO_LOG_WARN)) return;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+// Performance interface (the counters of the core are printed by perf_log)
+#define MAX_PERF_COUNTERS 16
+static struct retro_perf_counter *perf_counters[MAX_PERF_COUNTERS];
+static int nperf_counters = 0;
+
+static retro_time_t perf_get_time_usec(void)
+{
+  return (retro_time_t) clock() * 1000000 / CLOCKS_PER_SEC;
+}
+
+static retro_perf_tick_t perf_get_counter(void)
+{
+  return clock();
+}
+
+static uint64_t perf_get_cpu_features(void)
+{
+  return 0;
+}
+
+static void perf_register(struct retro_perf_counter *counter)
+{
+  if (nperf_counters == MAX_PERF_COUNTERS) return;
+  counter->registered = true;
+  perf_counters[nperf_counters++] = counter;
+}
+
+static void perf_start(struct retro_perf_counter *counter)
+{
+  counter->call_cnt++;
+  counter->start = clock();
+}
+
+static void perf_stop(struct retro_perf_counter *counter)
+{
+  counter->total += clock() - counter->start;
+}
+
+static void perf_log(void)
+{
+  int i;
+  if (!perf) return;
+  for (i = 0; i < nperf_counters; i++)
+    fprintf(stderr, "%-24s %10.3f s %10lu calls\n", perf_counters[i]->ident,
+            (double) perf_counters[i]->total / CLOCKS_PER_SEC,
+            (unsigned long) perf_counters[i]->call_cnt);
+}
+
+static bool environment(unsigned cmd, void *data)
+{
+  struct retro_perf_callback *perf_cb;
+  struct retro_variable *var;
+  switch (cmd)
+  {
+    case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+      ((struct retro_log_callback *) data)->log = log_printf;
+      return true;
+    case RETRO_ENVIRONMENT_GET_PERF_INTERFACE:
+      perf_cb = (struct retro_perf_callback *) data;
+      perf_cb->get_time_usec = perf_get_time_usec;
+      perf_cb->get_cpu_features = perf_get_cpu_features;
+      perf_cb->get_perf_counter = perf_get_counter;
+      perf_cb->perf_register = perf_register;
+      perf_cb->perf_start = perf_start;
+      perf_cb->perf_stop = perf_stop;
+      perf_cb->perf_log = perf_log;
+      return true;
+    case RETRO_ENVIRONMENT_GET_VARIABLE:
+      var = (struct retro_variable *) data;
+      if (strcmp(var->key, "theodore_rom") == 0) var->value = model;
+      else if (strcmp(var->key, "theodore_autorun") == 0) var->value = autorun ? "enabled" : "disabled";
+      else if (strcmp(var->key, "theodore_vkb_transparency") == 0) var->value = "0%";
+      else if (strcmp(var->key, "theodore_floppy_write_protect") == 0) var->value = "enabled";
+      else if (strcmp(var->key, "theodore_tape_write_protect") == 0) var->value = "enabled";
+      else if (strcmp(var->key, "theodore_perf_log") == 0) var->value = perf ? "enabled" : "disabled";
+      else if (strcmp(var->key, "theodore_profiler") == 0) var->value = profile ? "enabled" : "disabled";
+      else if (strcmp(var->key, "theodore_trace") == 0) var->value = trace;
+      else if (strcmp(var->key, "theodore_heatmap") == 0) var->value = heatmap ? "enabled" : "disabled";
+      else if (strcmp(var->key, "theodore_gdb_port") == 0) var->value = gdbport;
+      else if (strcmp(var->key, "theodore_disassembler") == 0) var->value = disassembler ? "enabled" : "disabled";
+      else var->value = "disabled";
+      return true;
+    case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
+      *(bool *) data = false;
+      return true;
+    case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+      return *(enum retro_pixel_format *) data == RETRO_PIXEL_FORMAT_RGB565;
+    case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME:
+    case RETRO_ENVIRONMENT_SET_VARIABLES:
+    case RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK:
+    case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS:
+    case RETRO_ENVIRONMENT_SET_PERFORMANCE_LEVEL:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void video_refresh(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+  (void) width, (void) height; // Unused parameters
+  if (data)
+  {
+    last_frame = (const uint16_t *) data;
+    last_frame_pitch = pitch / sizeof(uint16_t);
+  }
+}
+
+static void audio_sample(int16_t left, int16_t right)
+{
+  (void) left, (void) right; // Unused parameters
+}
+
+static size_t audio_sample_batch(const int16_t *data, size_t frames)
+{
+  (void) data; // Unused parameter
+  return frames;
+}
+
+static void input_poll(void)
+{
+}
+
+static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+  (void) index; // Unused parameter
+  if ((device != RETRO_DEVICE_JOYPAD) || (port > 1)) return 0;
+  switch (id)
+  {
+    case RETRO_DEVICE_ID_JOYPAD_UP: return joystick[port ? JOY1_UP : JOY0_UP];
+    case RETRO_DEVICE_ID_JOYPAD_DOWN: return joystick[port ? JOY1_DOWN : JOY0_DOWN];
+    case RETRO_DEVICE_ID_JOYPAD_LEFT: return joystick[port ? JOY1_LEFT : JOY0_LEFT];
+    case RETRO_DEVICE_ID_JOYPAD_RIGHT: return joystick[port ? JOY1_RIGHT : JOY0_RIGHT];
+    case RETRO_DEVICE_ID_JOYPAD_B: return joystick[port ? JOY1_FIRE : JOY0_FIRE];
+    default: return 0;
+  }
+}
+
+// Scripted input ////////////////////////////////////////////////////////////
+static bool load_script(const char *filename)
+{
+  FILE *fp;
+  char line[256], type[16], code[16], state[16];
+  int lineno = 0;
+  long frame;
+  int i;
+
+  fp = fopen(filename, "r");
+  if (fp == NULL)
+  {
+    fprintf(stderr, "Cannot open script %s.\n", filename);
+    return false;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    Event *e = &events[nevents];
+    lineno++;
+    if ((line[0] == '#') || (strspn(line, " \t\r\n") == strlen(line))) continue;
+    if ((sscanf(line, "%ld %15s %15s %15s", &frame, type, code, state) != 4)
+        || (nevents == MAX_EVENTS) || ((nevents > 0) && (frame < events[nevents-1].frame)))
+    {
+      fprintf(stderr, "%s:%d: invalid event.\n", filename, lineno);
+      fclose(fp);
+      return false;
+    }
+    e->frame = frame;
+    e->down = (strcmp(state, "down") == 0);
+    if (strcmp(type, "key") == 0)
+    {
+      e->type = EVENT_KEY;
+      e->code = (int) strtol(code, NULL, 0);
+    }
+    else
+    {
+      e->type = EVENT_JOY;
+      e->code = -1;
+      for (i = 0; i <= JOY1_FIRE; i++)
+      {
+        if (strcmp(code, axis_names[i]) == 0) e->code = i;
+      }
+      if ((strcmp(type, "joy") != 0) || (e->code < 0))
+      {
+        fprintf(stderr, "%s:%d: invalid event.\n", filename, lineno);
+        fclose(fp);
+        return false;
+      }
+    }
+    nevents++;
+  }
+  fclose(fp);
+  return true;
+}
+
+static int apply_events(long frame, int next)
+{
+  for (; (next < nevents) && (events[next].frame <= frame); next++)
+  {
+    if (events[next].type == EVENT_KEY) keyboard(events[next].code, events[next].down);
+    else joystick[events[next].code] = events[next].down;
+  }
+  return next;
+}
+
+// Hashes (FNV-1a, independent of the host byte order) ///////////////////////
+static unsigned long long hash_bytes(unsigned long long h, const unsigned char *p, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; i++)
+  {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static unsigned long long hash_frame(void)
+{
+  unsigned long long h = 0xcbf29ce484222325ULL;
+  unsigned char pixel[2];
+  int x, y;
+  if (last_frame == NULL) return 0;
+  for (y = 0; y < YBITMAP; y++)
+  {
+    for (x = 0; x < XBITMAP; x++)
+    {
+      pixel[0] = last_frame[y * last_frame_pitch + x] & 0xff;
+      pixel[1] = last_frame[y * last_frame_pitch + x] >> 8;
+      h = hash_bytes(h, pixel, 2);
+    }
+  }
+  return h;
+}
+
+int main(int argc, char *argv[])
+{
+  struct retro_game_info game;
+  const char *filename = NULL;
+  const char *script = NULL;
+  const char *workloads = NULL;
+  const char *reference = NULL;
+  bool benchmark = false;
+  bool opcodes = false;
+  bool write_reference = false;
+  long frames = DEFAULT_FRAMES;
+  long frame;
+  int i, next = 0;
+  clock_t start, start_frame, time_total, time_run = 0;
+  PerfCounters counters;
+  double seconds, cycles, instructions;
+
+  for (i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-m") == 0) && (i + 1 < argc)) model = argv[++i];
+    else if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc)) frames = atol(argv[++i]);
+    else if ((strcmp(argv[i], "-s") == 0) && (i + 1 < argc)) script = argv[++i];
+    else if (strcmp(argv[i], "-a") == 0) autorun = true;
+    else if (strcmp(argv[i], "-H") == 0) print_hashes = true;
+    else if (strcmp(argv[i], "-v") == 0) verbose = true;
+    else if (strcmp(argv[i], "-p") == 0) {perf = true; verbose = true;}
+    else if (strcmp(argv[i], "-P") == 0) profile = true;
+    else if ((strcmp(argv[i], "-T") == 0) && (i + 1 < argc)) trace = argv[++i];
+    else if (strcmp(argv[i], "-M") == 0) heatmap = true;
+    else if ((strcmp(argv[i], "-g") == 0) && (i + 1 < argc)) gdbport = argv[++i];
+    else if (strcmp(argv[i], "-d") == 0) disassembler = true;
+    else if (strcmp(argv[i], "-b") == 0) benchmark = true;
+    else if ((strcmp(argv[i], "-w") == 0) && (i + 1 < argc)) {benchmark = true; workloads = argv[++i];}
+    else if (strcmp(argv[i], "-o") == 0) opcodes = true;
+    else if ((strcmp(argv[i], "-O") == 0) && (i + 1 < argc)) {opcodes = true; reference = argv[++i];}
+    else if ((strcmp(argv[i], "-W") == 0) && (i + 1 < argc))
+    {
+      opcodes = write_reference = true;
+      reference = argv[++i];
+    }
+    else if ((argv[i][0] != '-') && (filename == NULL)) filename = argv[i];
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if ((frames <= 0) || ((script != NULL) && !load_script(script)))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  retro_set_environment(environment);
+  retro_set_video_refresh(video_refresh);
+  retro_set_audio_sample(audio_sample);
+  retro_set_audio_sample_batch(audio_sample_batch);
+  retro_set_input_poll(input_poll);
+  retro_set_input_state(input_state);
+  retro_init();
+
+  if (benchmark)
+  {
+    i = run_benchmarks(workloads);
+    retro_deinit();
+    return (i > 0) ? 0 : 1;
+  }
+
+  if (opcodes)
+  {
+    i = run_opcode_benchmarks(reference, write_reference);
+    retro_deinit();
+    return (i == 0) ? 0 : 1;
+  }
+
+  memset(&game, 0, sizeof(game));
+  game.path = filename;
+  if (!retro_load_game(filename ? &game : NULL))
+  {
+    fprintf(stderr, "Cannot load %s.\n", filename);
+    retro_deinit();
+    return 1;
+  }
+
+  // The cycles and instructions are counted by the core
+  counters = perfcounters;
+  start = clock();
+  for (frame = 0; frame < frames; frame++)
+  {
+    next = apply_events(frame, next);
+    start_frame = clock();
+    retro_run();
+    time_run += clock() - start_frame;
+  }
+  time_total = clock() - start;
+  cycles = (double) (perfcounters.cycles - counters.cycles);
+  instructions = (double) (perfcounters.instructions - counters.instructions);
+
+  seconds = (double) time_total / CLOCKS_PER_SEC;
+  printf("model: %s\n", model);
+  printf("file: %s\n", filename ? filename : "(none)");
+  printf("frames: %ld\n", frames);
+  printf("emulated time: %.2f s\n", (double) frames / VIDEO_FPS);
+  printf("host time: %.3f s\n", seconds);
+  printf("emulated cycles: %.0f\n", cycles);
+  printf("emulated instructions: %.0f\n", instructions);
+  if (seconds > 0)
+  {
+    printf("frames/s: %.1f\n", frames / seconds);
+    printf("emulated MHz: %.2f (%.1fx real time)\n",
+           cycles / seconds / 1000000,
+           frames / seconds / VIDEO_FPS);
+    printf("time emulation: %.3f s (%.1f%%)\n",
+           (double) time_run / CLOCKS_PER_SEC, 100.0 * time_run / time_total);
+    printf("time scripted input: %.3f s (%.1f%%)\n",
+           (double) (time_total - time_run) / CLOCKS_PER_SEC,
+           100.0 * (time_total - time_run) / time_total);
+  }
+  if (print_hashes)
+  {
+    printf("frame hash: %016llx\n", hash_frame());
+    printf("ram hash: %016llx\n", hash_bytes(0xcbf29ce484222325ULL,
+           (const unsigned char *) retro_get_memory_data(RETRO_MEMORY_SYSTEM_RAM),
+           retro_get_memory_size(RETRO_MEMORY_SYSTEM_RAM)));
+  }
+
+  retro_unload_game();
+  retro_deinit();
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Offline decoder of the execution traces written by the core (tracer.c):
+ * prints each recorded instruction disassembled, with its cycle stamp
+ * and the registers before its execution. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "6809cpu.h"
+#include "6809disasm.h"
+#include "tracer.h"
+
+// Record being disassembled
+static unsigned char record[TRACER_RECORD_SIZE];
+
+static unsigned short get_word(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+// Memory seen by the disassembler: the bytes recorded at PC
+static char TraceMgetc(unsigned short a)
+{
+  unsigned short offset = a - get_word(record + 8);
+  return (offset < TRACER_CODE_SIZE) ? record[22 + offset] : 0;
+}
+
+static void print_record(void)
+{
+  char instruction[100];
+  unsigned long long cycles = 0;
+  int i;
+  for (i = 7; i >= 0; i--) cycles = (cycles << 8) | record[i];
+  dasm6809(get_word(record + 8), instruction);
+  printf("%12llu %-36s A=%02X B=%02X X=%04X Y=%04X U=%04X S=%04X DP=%02X CC=%02X%s%s%s\n",
+         cycles, instruction, record[18], record[19], get_word(record + 10),
+         get_word(record + 12), get_word(record + 14), get_word(record + 16),
+         record[20], record[21],
+         (record[27] & INT_NMI) ? " NMI" : "", (record[27] & INT_FIRQ) ? " FIRQ" : "",
+         (record[27] & INT_IRQ) ? " IRQ" : "");
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-n N] [%s]\n", name, TRACER_FILE);
+  fprintf(stderr, "  -n N  only print the last N instructions\n");
+}
+
+int main(int argc, char *argv[])
+{
+  const char *filename = TRACER_FILE;
+  unsigned char header[TRACER_HEADER_SIZE];
+  long count, last = -1;
+  FILE *fp;
+  int i;
+
+  for (i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) last = atol(argv[++i]);
+    else if (argv[i][0] != '-') filename = argv[i];
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  fp = fopen(filename, "rb");
+  if (fp == NULL)
+  {
+    fprintf(stderr, "Cannot open %s.\n", filename);
+    return 1;
+  }
+  if ((fread(header, 1, TRACER_HEADER_SIZE, fp) != TRACER_HEADER_SIZE)
+      || (memcmp(header, TRACER_MAGIC, 8) != 0))
+  {
+    fprintf(stderr, "%s is not a trace of theodore.\n", filename);
+    fclose(fp);
+    return 1;
+  }
+  count = get_word(header + 8) | ((long) get_word(header + 10) << 16);
+  if ((last >= 0) && (last < count))
+  {
+    fseek(fp, (count - last) * TRACER_RECORD_SIZE, SEEK_CUR);
+    count = last;
+  }
+
+  Mgetc = TraceMgetc;
+  while ((count-- > 0) && (fread(record, 1, TRACER_RECORD_SIZE, fp) == TRACER_RECORD_SIZE))
+  {
+    print_record();
+  }
+  fclose(fp);
+  return 0;
+}
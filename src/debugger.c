@@ -21,6 +21,7 @@
 #include "debugger.h"
 #include "6809disasm.h"
 #include "6809cpu.h"
+#include "gdbstub.h"
 #include "motoemulator.h"
 
 #include <stdio.h>
@@ -29,67 +30,116 @@
 #include "boolean.h"
 
 #define DBG_ARRAY_LENGTH 100
-#define BP_LENGTH 20
 
 static DebuggerMode dbg_mode = DEBUG_DISABLED;
 static char dbg_instruction[DBG_ARRAY_LENGTH] = { 0 };
 static char dbg_registers[DBG_ARRAY_LENGTH] = { 0 };
 static char dbg_command[DBG_ARRAY_LENGTH] = { 0 };
 static bool break_on_illegal_opcode = false;
+// Address of the instruction being executed and registers before its execution
+static unsigned short dbg_address = 0;
+static Cpu6809 dbg_cpu;
+// True while the debugger itself reads the memory (disassembly, commands):
+// these reads must not trigger the memory breakpoints again
+static bool dbg_busy = false;
 
-// Breakpoints on the values of the program counter
-static unsigned short bp_pc[BP_LENGTH] = { 0 };
-static int bp_pc_numitems = 0;
-// Breakpoints on memory read addresses
-static unsigned short bp_read_mem[BP_LENGTH] = { 0 };
-static int bp_read_mem_numitems = 0;
-// Breakpoints on memory write addresses
-static unsigned short bp_write_mem[BP_LENGTH] = { 0 };
-static int bp_write_mem_numitems = 0;
+// Breakpoints: one bit per address for each owner and kind of breakpoint
+// (program counter, memory read, memory write)
+static unsigned char bp_bitmap[BP_OWNERS][BP_KINDS][0x10000 / 8];
+static int bp_count[BP_OWNERS][BP_KINDS] = { { 0 } };
+bool debug_mem_breakpoints = false;
+
+#define BP_IS_SET(owner, kind, a) (bp_bitmap[owner][kind][(a) >> 3] & (1 << ((a) & 7)))
+
+static void update_armed_flag(void)
+{
+  // Breakpoints used in the current mode
+  BreakpointOwner owner = (dbg_mode == DEBUG_REMOTE) ? BP_REMOTE : BP_LOCAL;
+  debug_mem_breakpoints = (dbg_mode != DEBUG_DISABLED)
+                          && ((bp_count[owner][BP_READ] > 0) || (bp_count[owner][BP_WRITE] > 0));
+  UpdateInstrumentation();
+}
 
 void debugger_setMode(DebuggerMode mode)
 {
   dbg_mode = mode;
+  update_armed_flag();
+}
+
+DebuggerMode debugger_getMode(void)
+{
+  return dbg_mode;
+}
+
+bool debugger_enabled(void)
+{
+  return dbg_mode != DEBUG_DISABLED;
 }
 
 static void print_registers(char* string)
 {
   sprintf(string, "A=%02X B=%02X X=%04X Y=%04X U=%04X S=%04X DP=%02X CC=%02X",
-      *dc6809_a & 0xFF, *dc6809_b & 0xFF, dc6809_x & 0xFFFF, dc6809_y & 0xFFFF,
-      dc6809_u & 0xFFFF, dc6809_s & 0xFFFF, *dc6809_dp & 0xFF, dc6809_cc & 0xFF);
+      dbg_cpu.d.b.h & 0xFF, dbg_cpu.d.b.l & 0xFF, dbg_cpu.x.w & 0xFFFF, dbg_cpu.y.w & 0xFFFF,
+      dbg_cpu.u.w & 0xFFFF, dbg_cpu.s.w & 0xFFFF, dbg_cpu.da.b.h & 0xFF, dbg_cpu.cc & 0xFF);
+}
+
+// Disassembles and prints the instruction at the given address with the registers
+static void print_instruction(unsigned short address)
+{
+  char (*savedgetc)(unsigned short) = Mgetc;
+  // The disassembler reads the code without side effects
+  Mgetc = Mpeek;
+  dasm6809(address, dbg_instruction);
+  Mgetc = savedgetc;
+  print_registers(dbg_registers);
+  printf("%s %s\n", dbg_instruction, dbg_registers);
 }
 
 static void list_breakpoints()
 {
-  int i;
-  printf("Breakpoints at PC addresses:\n");
-  for (i = 0; i < bp_pc_numitems; i++)
+  const char *titles[BP_KINDS] = { "Breakpoints at PC addresses:",
+                                   "Breakpoints on memory read addresses:",
+                                   "Breakpoints on memory write addresses:" };
+  int kind, a;
+  for (kind = 0; kind < BP_KINDS; kind++)
   {
-    printf("%04x\n", bp_pc[i]);
+    printf("%s\n", titles[kind]);
+    for (a = 0; (a < 0x10000) && (bp_count[BP_LOCAL][kind] > 0); a++)
+    {
+      if (BP_IS_SET(BP_LOCAL, kind, a)) printf("%04x\n", a);
+    }
   }
-  printf("Breakpoints on memory read addresses:\n");
-  for (i = 0; i < bp_read_mem_numitems; i++)
+}
+
+void debugger_clear_breakpoints(BreakpointOwner owner)
+{
+  memset(bp_bitmap[owner], 0, sizeof(bp_bitmap[owner]));
+  memset(bp_count[owner], 0, sizeof(bp_count[owner]));
+  update_armed_flag();
+}
+
+void debugger_set_breakpoint(BreakpointOwner owner, BreakpointKind kind, unsigned short address, bool set)
+{
+  if (set && !BP_IS_SET(owner, kind, address))
   {
-    printf("%04x\n", bp_read_mem[i]);
+    bp_bitmap[owner][kind][address >> 3] |= 1 << (address & 7);
+    bp_count[owner][kind]++;
+    update_armed_flag();
   }
-  printf("Breakpoints on memory write addresses:\n");
-  for (i = 0; i < bp_write_mem_numitems; i++)
+  else if (!set && BP_IS_SET(owner, kind, address))
   {
-    printf("%04x\n", bp_write_mem[i]);
+    bp_bitmap[owner][kind][address >> 3] &= ~(1 << (address & 7));
+    bp_count[owner][kind]--;
+    update_armed_flag();
   }
 }
 
-static void clear_breakpoints()
+bool debugger_has_breakpoint(BreakpointOwner owner, BreakpointKind kind, unsigned short address)
 {
-  memset(bp_pc, 0, BP_LENGTH * sizeof(bp_pc[0]));
-  bp_pc_numitems = 0;
-  memset(bp_read_mem, 0, BP_LENGTH * sizeof(bp_read_mem[0]));
-  bp_read_mem_numitems = 0;
-  memset(bp_write_mem, 0, BP_LENGTH * sizeof(bp_write_mem[0]));
-  bp_write_mem_numitems = 0;
+  return BP_IS_SET(owner, kind, address) != 0;
 }
 
-static void add_breakpoint(unsigned short *bp_list, int *bp_num_items, char *value)
+static void add_breakpoint(BreakpointKind kind, char *value)
 {
   char *endptr;
   unsigned short val = (unsigned short) strtol(value, &endptr, 16);
@@ -98,10 +148,7 @@ static void add_breakpoint(unsigned short *bp_list, int *bp_num_items, char *val
     printf("Invalid address value\n");
     return;
   }
-  if (*bp_num_items < BP_LENGTH)
-  {
-    bp_list[(*bp_num_items)++] = val;
-  }
+  debugger_set_breakpoint(BP_LOCAL, kind, val, true);
 }
 
 static void read_debugger_command()
@@ -145,22 +192,22 @@ static void read_debugger_command()
     // Clear the current list of breakpoints
     else if (strcmp(dbg_command, "bp clear\n") == 0)
     {
-      clear_breakpoints();
+      debugger_clear_breakpoints(BP_LOCAL);
     }
     // Add a breakpoint at the given program address (in hex)
     else if (strncmp(dbg_command, "bp pc ", 6) == 0)
     {
-      add_breakpoint(bp_pc, &bp_pc_numitems, dbg_command + 6);
+      add_breakpoint(BP_PC, dbg_command + 6);
     }
     // Add a breakpoint when reading at the given address (in hex)
     else if (strncmp(dbg_command, "bp read ", 8) == 0)
     {
-      add_breakpoint(bp_read_mem, &bp_read_mem_numitems, dbg_command + 8);
+      add_breakpoint(BP_READ, dbg_command + 8);
     }
     // Add a breakpoint when writing at the givent address (in hex)
     else if (strncmp(dbg_command, "bp write ", 9) == 0)
     {
-      add_breakpoint(bp_write_mem, &bp_write_mem_numitems, dbg_command + 9);
+      add_breakpoint(BP_WRITE, dbg_command + 9);
     }
     // Read a memory location
     else if (strncmp(dbg_command, "read ", 5) == 0)
@@ -171,7 +218,7 @@ static void read_debugger_command()
         printf("Invalid address value\n");
         return;
       }
-      printf("ram[%04x] = %02x\n", address, Mgetc(address) & 0xFF);
+      printf("ram[%04x] = %02x\n", address, Mpeek(address) & 0xFF);
     }
     // Write a memory location
     else if (strncmp(dbg_command, "write ", 6) == 0)
@@ -198,77 +245,84 @@ static void read_debugger_command()
   }
 }
 
-static bool check_breakpoint(unsigned short *bp_list, int bp_list_numitems, unsigned short address)
+bool debug(unsigned short address)
 {
-  int i = 0;
-  while (i < bp_list_numitems)
+  if (dbg_mode == DEBUG_REMOTE)
   {
-    if (bp_list[i] == address)
-    {
-      return true;
-    }
-    ++i;
+    return gdbstub_instruction((bp_count[BP_REMOTE][BP_PC] > 0) && BP_IS_SET(BP_REMOTE, BP_PC, address));
   }
-  return false;
-}
-
-void debug(unsigned short address)
-{
   if (dbg_mode != DEBUG_DISABLED)
   {
-    if (check_breakpoint(bp_pc, bp_pc_numitems, address))
+    dbg_address = address;
+    dbg_cpu = dc6809;
+    if ((bp_count[BP_LOCAL][BP_PC] > 0) && BP_IS_SET(BP_LOCAL, BP_PC, address))
     {
       printf("Breakpoint at PC=%04x\n", address);
       debugger_setMode(DEBUG_STEP);
     }
-    dasm6809(address, dbg_instruction);
-    print_registers(dbg_registers);
+    // In RUN mode, the instruction is only disassembled when a breakpoint is met
     if (dbg_mode != DEBUG_RUN)
     {
-      printf("%s %s\n", dbg_instruction, dbg_registers);
+      dbg_busy = true;
+      print_instruction(address);
       if (dbg_mode == DEBUG_STEP)
       {
         read_debugger_command();
       }
+      dbg_busy = false;
     }
   }
+  return true;
 }
 
-static void debug_mem(unsigned short address, bool is_read)
+static void debug_mem(unsigned short address, BreakpointKind kind)
 {
-  if (dbg_mode != DEBUG_DISABLED)
+  if (dbg_busy)
   {
-    if (is_read ? check_breakpoint(bp_read_mem, bp_read_mem_numitems, address)
-                : check_breakpoint(bp_write_mem, bp_write_mem_numitems, address))
+    return;
+  }
+  if ((dbg_mode == DEBUG_REMOTE) && BP_IS_SET(BP_REMOTE, kind, address))
+  {
+    gdbstub_watchpoint(address, kind == BP_READ);
+  }
+  else if ((dbg_mode != DEBUG_DISABLED) && BP_IS_SET(BP_LOCAL, kind, address))
+  {
+    printf("Breakpoint: memory %s at %04x\n", (kind == BP_READ) ? "read" : "write", address);
+    dbg_busy = true;
+    // If in RUN mode, print the current instruction
+    // (in other modes, it was already printed)
+    if (dbg_mode == DEBUG_RUN)
     {
-      printf("Breakpoint: memory %s at %04x\n", is_read ? "read" : "write", address);
-      // If in RUN mode, print the current instruction
-      // (in other modes, it was already printed)
-      if (dbg_mode == DEBUG_RUN)
-      {
-        printf("%s %s\n", dbg_instruction, dbg_registers);
-      }
-      debugger_setMode(DEBUG_STEP);
-      read_debugger_command();
+      print_instruction(dbg_address);
     }
+    debugger_setMode(DEBUG_STEP);
+    read_debugger_command();
+    dbg_busy = false;
   }
 }
 
 void debug_mem_read(unsigned short address)
 {
-  debug_mem(address, true);
+  debug_mem(address, BP_READ);
 }
 
 void debug_mem_write(unsigned short address)
 {
-  debug_mem(address, false);
+  debug_mem(address, BP_WRITE);
 }
 
 void debugger_break(void)
 {
+  if (dbg_mode == DEBUG_REMOTE)
+  {
+    gdbstub_break(GDB_SIGNAL_ILL);
+    return;
+  }
   debugger_setMode(DEBUG_STEP);
-  printf("%s %s\n", dbg_instruction, dbg_registers);
+  dbg_busy = true;
+  print_instruction(dbg_address);
   read_debugger_command();
+  dbg_busy = false;
 }
 
 void debugger_set_break_on_illegal_opcode(bool enabled)
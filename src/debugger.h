@@ -33,17 +33,42 @@ typedef enum
   /* Debugger enabled: disassembles and prints all the instructions. */
   DEBUG_TRACE,
   /* Step-by-step mode: disassembles and prints an instruction and wait for a keystroke. */
-  DEBUG_STEP
+  DEBUG_STEP,
+  /* Debugger driven by a GDB client (gdbstub.c): the breakpoints stop the emulation
+     instead of waiting for a command on the standard input. */
+  DEBUG_REMOTE
 } DebuggerMode;
 
+/* Kinds of breakpoints. */
+typedef enum { BP_PC, BP_READ, BP_WRITE, BP_KINDS } BreakpointKind;
+/* Owners of the breakpoints: the commands of the debugger and the GDB client
+   have separate breakpoints (only those of the GDB client are used in remote mode). */
+typedef enum { BP_LOCAL, BP_REMOTE, BP_OWNERS } BreakpointOwner;
+
+/* True when the debugger is enabled and at least one breakpoint is set on
+   a memory access: debug_mem_read()/debug_mem_write() only need to be called then
+   (the emulator then uses memory handlers that call them). */
+extern bool debug_mem_breakpoints;
+
 /* Sets the debugger mode. */
 void debugger_setMode(DebuggerMode mode);
-/* Debug the instruction at the given address. */
-void debug(unsigned short address);
+/* Returns the debugger mode. */
+DebuggerMode debugger_getMode(void);
+/* True if the debugger is enabled (the instructions must then be passed to debug()). */
+bool debugger_enabled(void);
+/* Debug the instruction at the given address.
+   Returns false if the emulation must stop before this instruction (remote mode). */
+bool debug(unsigned short address);
 /* Check if a breakpoint is set for a memory read at the given address. */
 void debug_mem_read(unsigned short address);
 /* Check if a breakpoint is set for a memory write at the given address. */
 void debug_mem_write(unsigned short address);
+/* Sets or removes a breakpoint. */
+void debugger_set_breakpoint(BreakpointOwner owner, BreakpointKind kind, unsigned short address, bool set);
+/* True if a breakpoint is set at the given address. */
+bool debugger_has_breakpoint(BreakpointOwner owner, BreakpointKind kind, unsigned short address);
+/* Removes all the breakpoints of the given owner. */
+void debugger_clear_breakpoints(BreakpointOwner owner);
 /* Sets the debugger mode to STEP and break on the current instruction. */
 void debugger_break(void);
 /* Enable/disable break on illegal opcode. */
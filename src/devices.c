@@ -20,19 +20,35 @@
 /* Emulation of Thomson devices (floppy/tape/cartridge drives, printer, light pen, mouse) */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "6809cpu.h"
+#include "logger.h"
 #include "sap.h"
+#include "vfs.h"
 #include "motoemulator.h"
-#ifdef THEODORE_DASM
 #include "debugger.h"
-#endif
+#include "devices.h"
 
 #define SECTOR_SIZE      256  // Size in bytes of a double density sector
 #define NB_TRACKS         80  // Number of tracks in a floppy
 #define SECTORS_PER_TRACK 16  // Number of sectors in a track
 #define SECTORS_PER_SIDE  SECTORS_PER_TRACK * NB_TRACKS
+#define NB_UNITS           4  // Number of sides of the internal and external drives
+#define K7_MAX_FILES      64  // Max number of files in the index of a tape
+#define K7_NAME_LENGTH    11  // Length of a file name in a tape header block (8 + 3)
+#define FD_MAX_SECTORS    (NB_UNITS * SECTORS_PER_SIDE)
+#define RAMDISK_UNIT       4  // Drive number of the RAM disk
+#define RAMDISK_SIZE      (SECTORS_PER_SIDE * SECTOR_SIZE) // Max size of the RAM disk
+#define FAT_TRACK         20  // Track of the directory and of the FAT
+// Number of tracks written by the format routine of the controller when its
+// last track cannot be found in the routine (see FormatTracks):
+// 3"1/2 drives of the TO computers (320 KB per side),
+// 5"1/4 drives of the CD 90-640 controller of the MO computers (160 KB per side)
+#define FORMAT_TRACKS_TO  80
+#define FORMAT_TRACKS_MO  40
+#define FORMAT_SCAN_SIZE  0x80 // Size of the format routine searched for its last track
 
 // Base address of the page 0 of the monitor software for MO and TO computers
 #define MONITOR_PAGE_0_MO 0x2000
@@ -42,23 +58,57 @@
 static bool fdprotection = true;
 static bool k7protection = true;
 static bool printerEnabled = false;
-static FILE *ffd = NULL;   // floppy file (fd format)
-static FILE *fk7 = NULL;   // tape file
+// Floppy disk of the set (fd or sap format), loaded entirely in memory
+typedef struct
+{
+  VfsFile *file;  // fd file (NULL if read-only)
+  char *image;    // content of the fd file (written back by FlushMedia)
+  long size;      // size of the fd file
+  bool dirty[FD_MAX_SECTORS]; // sectors modified since the last write-back
+  bool modified;
+  SapFile sap;    // sap file (sap.data is NULL with the fd format)
+} Floppy;
+static Floppy floppies[FLOPPY_MAX_DISKS]; // disks of the set
+static int nfloppies = 0;
+static Floppy nofloppy;             // empty drive
+static Floppy *floppy = &nofloppy;  // disk in the drive (swapping disks only changes it)
+static VfsFile *fk7 = NULL;   // tape file (NULL if read-only)
+static char *k7image = NULL;  // content of the tape (written back by FlushMedia)
+static long k7size;           // size of the tape
+static long k7capacity;       // size of the k7image buffer
+static long k7pos;            // position of the tape
+static long k7dirty = -1;     // first byte modified since the last write-back (-1: none)
+// Index of the files of the tape (position of the leader of their header block)
+typedef struct
+{
+  long pos;
+  char name[K7_NAME_LENGTH + 2]; // "NAME.EXT"
+} TapeFile;
+static TapeFile k7files[K7_MAX_FILES];
+static int k7nfiles = 0;
+static bool k7indexed = false; // false when the index must be rebuilt
+static unsigned int k7checksum;  // checksum of the content of the tape (saved in the states)
+static bool k7summed = false;    // false when the checksum must be computed again
 static FILE *fprn = NULL;  // printer file
-static SapFile sap = { 0, NULL }; // floppy file (sap format)
+static char ramdisk[RAMDISK_SIZE]; // RAM disk (drive 4)
+static int ramdisktracks = 0;      // size of the RAM disk (0 if the model has none)
+static bool ramdiskpreload = false; // copy of the floppy disk to the RAM disk at load
 static int p0 = MONITOR_PAGE_0_TO;
 static bool is_to = true;
 
+static unsigned long mediaio = 0; // nb of tape and floppy I/O opcodes run
+static const TapeBlockRoutine *k7block = NULL; // block read routine of the monitor
+static bool k7fastload = true;
 static int k7octet = 0;
 static int k7bit = 0;
 
 // 6809 registers
-#define CC dc6809_cc
-#define A *dc6809_a
-#define B *dc6809_b
-#define X dc6809_x
-#define Y dc6809_y
-#define S dc6809_s
+#define CC dc6809.cc
+#define A dc6809.d.b.h
+#define B dc6809.d.b.l
+#define X dc6809.x.w
+#define Y dc6809.y.w
+#define S dc6809.s.w
 
 void SetModeTO(bool isTO)
 {
@@ -66,6 +116,21 @@ void SetModeTO(bool isTO)
   is_to = isTO;
 }
 
+void SetTapeBlockRoutine(const TapeBlockRoutine *routine)
+{
+  k7block = routine;
+}
+
+void SetTapeFastLoad(bool enabled)
+{
+  k7fastload = enabled;
+}
+
+void SetRamDiskPreload(bool enabled)
+{
+  ramdiskpreload = enabled;
+}
+
 void SetFloppyWriteProtect(bool enabled)
 {
   fdprotection = enabled;
@@ -106,30 +171,34 @@ static void Readsector(void)
   char buffer[SECTOR_SIZE];
   int i, j, u, p, s;
 
-  if (ffd == NULL && sap.handle == NULL) {Diskerror(DISK_NO_DISK_ERROR); return;}
   // Drive number (0/1: 2 sides of the internal drive,
   //               2/3: 2 sides of the external drive,
   //               4  : RAM disk)
-  u = Mgetc(p0+0x49) & 0xff; if(u > 3) {Diskerror(DISK_IO_ERROR); return;}
+  u = Mgetc(p0+0x49) & 0xff; if(u > RAMDISK_UNIT) {Diskerror(DISK_IO_ERROR); return;}
+  if ((u != RAMDISK_UNIT) && (floppy->image == NULL) && (floppy->sap.data == NULL)) {Diskerror(DISK_NO_DISK_ERROR); return;}
   // Track number (0->79)
   p = Mgetc(p0+0x4a) & 0xff; if(p != 0) {Diskerror(DISK_IO_ERROR); return;}
   p = Mgetc(p0+0x4b) & 0xff; if(p >= NB_TRACKS) {Diskerror(DISK_IO_ERROR); return;}
   // Sector number
   s = Mgetc(p0+0x4c) & 0xff; if((s == 0) || (s > SECTORS_PER_TRACK)) {Diskerror(DISK_IO_ERROR); return;}
   for (j = 0; j < SECTOR_SIZE; j++) buffer[j] = 0xe5;
-  if (ffd != NULL)
+  if (u == RAMDISK_UNIT)
+  {
+    // RAM disk
+    if (p >= ramdisktracks) {Diskerror(DISK_IO_ERROR); return;}
+    memcpy(buffer, ramdisk + ((SECTORS_PER_TRACK * p + s - 1) << 8), SECTOR_SIZE);
+  }
+  else if (floppy->image != NULL)
   {
     // FD file
     s += SECTORS_PER_TRACK * p + SECTORS_PER_SIDE * u;
-    if (fseek(ffd, 0, SEEK_END)) {Diskerror(DISK_IO_ERROR); return;}
-    if ((s << 8) > ftell(ffd)) {Diskerror(DISK_IO_ERROR); return;}
-    if (fseek(ffd, (s - 1) << 8, SEEK_SET)) {Diskerror(DISK_IO_ERROR); return;}
-    if (fread(buffer, SECTOR_SIZE, 1, ffd) == 0) {Diskerror(DISK_IO_ERROR); return;}
+    if ((s << 8) > floppy->size) {Diskerror(DISK_IO_ERROR); return;}
+    memcpy(buffer, floppy->image + ((s - 1) << 8), SECTOR_SIZE);
   }
   else
   {
     // SAP file
-    int errcode = sap_readSector(&sap, p, s, buffer);
+    int errcode = sap_readSector(&floppy->sap, p, s, buffer);
     if (errcode != DISK_NO_ERROR) {Diskerror(errcode); return;}
   }
   i = ((Mgetc(p0+0x4f) & 0xff) << 8) + (Mgetc(p0+0x50) & 0xff);
@@ -143,12 +212,15 @@ static void Writesector(void)
   char buffer[SECTOR_SIZE];
   int i, j, u, p, s;
 
-  if (ffd == NULL && sap.handle == NULL) {Diskerror(DISK_NO_DISK_ERROR); return;}
-  if (fdprotection) {Diskerror(DISK_WRITE_PROTECTION_ERROR); return;}
   // Drive number (0/1: 2 sides of the internal drive,
   //               2/3: 2 sides of the external drive,
   //               4  : RAM disk)
-  u = Mgetc(p0+0x49) & 0xff; if(u > 3) {Diskerror(DISK_IO_ERROR); return;}
+  u = Mgetc(p0+0x49) & 0xff; if(u > RAMDISK_UNIT) {Diskerror(DISK_IO_ERROR); return;}
+  if (u != RAMDISK_UNIT)
+  {
+    if ((floppy->image == NULL) && (floppy->sap.data == NULL)) {Diskerror(DISK_NO_DISK_ERROR); return;}
+    if (fdprotection) {Diskerror(DISK_WRITE_PROTECTION_ERROR); return;}
+  }
   // Track number (0->79)
   p = Mgetc(p0+0x4a) & 0xff; if(p != 0) {Diskerror(DISK_IO_ERROR); return;}
   p = Mgetc(p0+0x4b) & 0xff; if(p >= NB_TRACKS) {Diskerror(DISK_IO_ERROR); return;}
@@ -156,108 +228,378 @@ static void Writesector(void)
   s = Mgetc(p0+0x4c) & 0xff; if((s == 0) || (s > SECTORS_PER_TRACK)) {Diskerror(DISK_IO_ERROR); return;}
   i = SECTOR_SIZE * (Mgetc(p0+0x4f) & 0xff) + (Mgetc(p0+0x50) & 0xff);
   for (j = 0; j < SECTOR_SIZE; j++) buffer[j] = Mgetc(i++);
-  if (ffd != NULL)
+  if (u == RAMDISK_UNIT)
   {
-    // FD file
+    // RAM disk
+    if (p >= ramdisktracks) {Diskerror(DISK_IO_ERROR); return;}
+    memcpy(ramdisk + ((SECTORS_PER_TRACK * p + s - 1) << 8), buffer, SECTOR_SIZE);
+  }
+  else if (floppy->image != NULL)
+  {
+    // FD file (the file grows if the sector is beyond its end)
     s += SECTORS_PER_TRACK * p + SECTORS_PER_SIDE * u;
-    if (fseek(ffd, (s - 1) << 8, SEEK_SET)) {Diskerror(DISK_IO_ERROR); return;}
-    if (fwrite(buffer, SECTOR_SIZE, 1, ffd) == 0) {Diskerror(DISK_IO_ERROR); return;}
+    memcpy(floppy->image + ((s - 1) << 8), buffer, SECTOR_SIZE);
+    if ((s << 8) > floppy->size) floppy->size = s << 8;
+    floppy->dirty[s - 1] = floppy->modified = true;
   }
   else
   {
     // SAP file
-    int errcode = sap_writeSector(&sap, p, s, buffer);
+    int errcode = sap_writeSector(&floppy->sap, p, s, buffer);
     if (errcode != DISK_NO_ERROR) {Diskerror(errcode); return;}
   }
 }
 
+// Format a unit (side of a floppy disk or RAM disk) of fatlength blocks
+// of 8 sectors (80=160Ko, 160=320Ko)
+static void FormatUnit(char *unit, int fatlength)
+{
+  int i;
+  char *fat;
+  // Initialisation of the whole disk with 0xE5
+  memset(unit, 0xe5, (fatlength * 8) << 8);
+  // Initialisation of track 20 at 0xFF
+  memset(unit + ((FAT_TRACK * SECTORS_PER_TRACK) << 8), 0xff, SECTORS_PER_TRACK << 8);
+  // Write the FAT
+  fat = unit + ((FAT_TRACK * SECTORS_PER_TRACK + 1) << 8);
+  fat[0x00] = 0;
+  fat[2 * FAT_TRACK + 1] = 0xfe; fat[2 * FAT_TRACK + 2] = 0xfe;
+  for (i = fatlength + 1; i < SECTOR_SIZE; i++) fat[i] = 0xfe;
+}
+
+// Number of tracks formatted by the DKFORM routine of the controller.
+// The routine formats the tracks until its "CMPA #last track, BEQ" test
+// (#$4F in the TO monitors, #$27 in the CD 90-640 ROM), which follows the
+// I/O opcode patched at its beginning: the test is read from the ROM, so
+// the number of tracks is the one of the drive of the controller.
+static int FormatTracks(void)
+{
+  int a, track;
+  for (a = dc6809.pc.uw; a < dc6809.pc.uw + FORMAT_SCAN_SIZE; a++)
+  {
+    if (((Mpeek(a) & 0xff) != 0x81) || ((Mpeek(a + 2) & 0xff) != 0x27)) continue;
+    track = Mpeek(a + 1) & 0xff;
+    if ((track >= FAT_TRACK) && (track < NB_TRACKS)) return track + 1;
+  }
+  return is_to ? FORMAT_TRACKS_TO : FORMAT_TRACKS_MO;
+}
+
 // Format a floppy disk.
 // This function emulates the DKFORM function of the monitor.
 static void Formatdisk(void)
 {
-  char buffer[SECTOR_SIZE];
-  int i, u, fatlength;
-  if (ffd == NULL) {Diskerror(DISK_NO_DISK_ERROR); return;}
+  int u, fatlength;
+  u = Mgetc(p0+0x49) & 0xff; // Unit
+  if (u == RAMDISK_UNIT)
+  {
+    if (ramdisktracks == 0) {Diskerror(DISK_IO_ERROR); return;}
+    FormatUnit(ramdisk, 2 * ramdisktracks);
+    return;
+  }
+  if (floppy->image == NULL) {Diskerror(DISK_NO_DISK_ERROR); return;}
   if (fdprotection) {Diskerror(DISK_WRITE_PROTECTION_ERROR); return;}
-  u = Mgetc(p0+0x49) & 0xff; if(u > 03) return; // Unit
-  u = (SECTORS_PER_SIDE * u) << 8; // Start of the unit in the .fd file
-  fatlength = 160;     // 80=160Ko, 160=320Ko
-  // rem: fatlength provisoire !!!!! (tester la variable adequate)
-  // Initialisation of the whole disk with 0xE5
-  for (i = 0; i < SECTOR_SIZE; i++) buffer[i] = 0xe5;
-  if (fseek(ffd, u, SEEK_SET)) {Diskerror(DISK_IO_ERROR); return;}
-  for (i = 0; i < (fatlength * 8); i++)
-    if (fwrite(buffer, SECTOR_SIZE, 1, ffd) == 0) {Diskerror(DISK_IO_ERROR); return;}
-  // Initialisation of track 20 at 0xFF
-  for (i = 0; i < SECTOR_SIZE; i++) buffer[i] = 0xff;
-  if (fseek(ffd, u + 0x14000, SEEK_SET)) {Diskerror(DISK_IO_ERROR); return;}
-  for (i = 0; i < SECTORS_PER_TRACK; i++)
-    if (fwrite(buffer, SECTOR_SIZE, 1, ffd) == 0) {Diskerror(DISK_IO_ERROR); return;}
-  // Write the FAT
-  buffer[0x00] = 0;
-  buffer[0x29] = 0xfe; buffer[0x2a] = 0xfe;
-  for (i = fatlength + 1; i < SECTOR_SIZE; i++) buffer[i] = 0xfe;
-  if (fseek(ffd, u + 0x14100, SEEK_SET)) {Diskerror(DISK_IO_ERROR); return;}
-  if (fwrite(buffer, SECTOR_SIZE, 1, ffd) == 0) {Diskerror(DISK_IO_ERROR); return;}
+  if(u > 03) return;
+  u = SECTORS_PER_SIDE * u; // First sector of the unit in the .fd file
+  // 2 blocks per track: 80=160Ko, 160=320Ko
+  fatlength = 2 * FormatTracks();
+  // The unit is formatted in memory, then written back at once by FlushMedia
+  // (the modified sectors are consecutive)
+  FormatUnit(floppy->image + (u << 8), fatlength);
+  memset(floppy->dirty + u, true, fatlength * 8);
+  floppy->modified = true;
+  if (((u + fatlength * 8) << 8) > floppy->size) floppy->size = (u + fatlength * 8) << 8;
+}
+
+// Write the modified sectors of a floppy disk back to its file
+static void FlushFloppy(Floppy *f)
+{
+  int s, n;
+  if (f->sap.data && !sap_flush(&f->sap)) LOG_ERROR("Write error on the floppy disk.\n");
+  if (!f->modified || (f->file == NULL)) return;
+  f->modified = false;
+  for (s = 0; s < FD_MAX_SECTORS; s += n)
+  {
+    // Consecutive modified sectors are written at once
+    for (n = 0; (s + n < FD_MAX_SECTORS) && f->dirty[s + n]; n++) f->dirty[s + n] = false;
+    if (n == 0) {n = 1; continue;}
+    if (!vfs_write(f->file, (long) s << 8, f->image + (s << 8), (long) n << 8))
+    {
+      LOG_ERROR("Write error on the floppy disk.\n");
+      break;
+    }
+  }
+  vfs_flush(f->file);
+}
+
+void FlushMedia(void)
+{
+  int i;
+  if ((k7dirty >= 0) && (fk7 != NULL))
+  {
+    if (!vfs_write(fk7, k7dirty, k7image + k7dirty, k7size - k7dirty) || !vfs_flush(fk7))
+      LOG_ERROR("Write error on the tape.\n");
+    k7dirty = -1;
+  }
+  // The disks of the set which are not in the drive may have been modified before a swap
+  for (i = 0; i < nfloppies; i++) FlushFloppy(&floppies[i]);
+}
+
+// Opens the file of a media for the write-back of its modifications
+static VfsFile *open_writeback(const char *filename)
+{
+  VfsFile *file = ((filename != NULL) && (filename[0] != '\0')) ? vfs_open(filename) : NULL;
+  if (file == NULL) LOG_INFO("The media cannot be written back: its modifications will be lost.\n");
+  return file;
+}
+
+void PreloadRamDisk(void)
+{
+  int p, s;
+  char *sector;
+  if (!ramdiskpreload || (ramdisktracks == 0)) return;
+  for (p = 0; p < ramdisktracks; p++)
+  {
+    for (s = 1; s <= SECTORS_PER_TRACK; s++)
+    {
+      sector = ramdisk + ((SECTORS_PER_TRACK * p + s - 1) << 8);
+      if (floppy->image != NULL) memcpy(sector, floppy->image + ((SECTORS_PER_TRACK * p + s - 1) << 8), SECTOR_SIZE);
+      else if (floppy->sap.data != NULL) sap_readSector(&floppy->sap, p, s, sector);
+    }
+  }
+}
+
+void SetRamDiskSize(int tracks)
+{
+  ramdisktracks = (tracks < NB_TRACKS) ? tracks : NB_TRACKS;
+  // empty formatted disk
+  memset(ramdisk, 0, RAMDISK_SIZE);
+  if (ramdisktracks > 0) FormatUnit(ramdisk, 2 * ramdisktracks);
+  PreloadRamDisk();
 }
 
 void UnloadFloppy(void)
 {
-  if (ffd) {fclose(ffd); ffd = NULL;}
-  if (sap.handle) {sap_close(&sap);}
+  int i;
+  Floppy *f;
+  FlushMedia();
+  for (i = 0; i < nfloppies; i++)
+  {
+    f = &floppies[i];
+    if (f->file) {vfs_close(f->file); f->file = NULL;}
+    free(f->image);
+    f->image = NULL;
+    f->modified = false;
+    if (f->sap.data) {sap_close(&f->sap);}
+  }
+  nfloppies = 0;
+  floppy = &nofloppy;
 }
 
-void LoadFd(const char *filename)
+bool AddFdFromArray(const char *filename, const char *data, long size)
+{
+  Floppy *f;
+  if (nfloppies >= FLOPPY_MAX_DISKS) return false;
+  f = &floppies[nfloppies];
+  //la disquette est chargee entierement en memoire
+  //(les secteurs modifies sont reecrits par FlushMedia)
+  f->image = calloc(FD_MAX_SECTORS, SECTOR_SIZE);
+  if (f->image == NULL) return false;
+  f->size = (size < FD_MAX_SECTORS * SECTOR_SIZE) ? size : FD_MAX_SECTORS * SECTOR_SIZE;
+  memcpy(f->image, data, f->size);
+  memset(f->dirty, 0, sizeof(f->dirty));
+  f->modified = false;
+  f->file = open_writeback(filename);
+  nfloppies++;
+  return true;
+}
+
+bool AddSapFromArray(const char *filename, const char *data, long size)
+{
+  Floppy *f;
+  if (nfloppies >= FLOPPY_MAX_DISKS) return false;
+  f = &floppies[nfloppies];
+  f->sap = sap_open(filename, data, size);
+  if (f->sap.data == NULL) return false;
+  nfloppies++;
+  return true;
+}
+
+int GetFloppyCount(void)
+{
+  return nfloppies;
+}
+
+int GetFloppy(void)
+{
+  return (floppy == &nofloppy) ? -1 : (int) (floppy - floppies);
+}
+
+void InsertFloppy(int index)
+{
+  floppy = ((index >= 0) && (index < nfloppies)) ? &floppies[index] : &nofloppy;
+}
+
+void LoadFdFromArray(const char *filename, const char *data, long size)
 {
   //fermeture disquette eventuellement ouverte
   UnloadFloppy();
-  if(filename[0] == '\0') return;
-  //ouverture de la nouvelle disquette
-  ffd = fopen(filename, "rb+");
+  if (AddFdFromArray(filename, data, size)) InsertFloppy(0);
+  PreloadRamDisk();
 }
 
-void LoadSap(const char *filename)
+void LoadFd(const char *filename)
+{
+  long size;
+  char *data;
+  if ((filename[0] == '\0') || ((data = vfs_read_file(filename, &size)) == NULL))
+  {
+    UnloadFloppy();
+    return;
+  }
+  LoadFdFromArray(filename, data, size);
+  free(data);
+}
+
+void LoadSapFromArray(const char *filename, const char *data, long size)
 {
   UnloadFloppy();
-  sap = sap_open(filename);
+  if (AddSapFromArray(filename, data, size)) InsertFloppy(0);
+  PreloadRamDisk();
+}
+
+void LoadSap(const char *filename)
+{
+  long size;
+  char *data = vfs_read_file(filename, &size);
+  if (data == NULL)
+  {
+    UnloadFloppy();
+    return;
+  }
+  LoadSapFromArray(filename, data, size);
+  free(data);
 }
 
 void UnloadTape(void)
 {
-  if(fk7) {fclose(fk7); fk7 = NULL;}
+  FlushMedia();
+  if (fk7) {vfs_close(fk7); fk7 = NULL;}
+  free(k7image);
+  k7image = NULL;
+  k7dirty = -1;
 }
 
-void LoadTape(const char *filename)
+void LoadTapeFromArray(const char *filename, const char *data, long size)
 {
   UnloadTape();
-  if(filename[0] == '\0') return;
-  fk7 = fopen(filename, "rb+");
+  //la cassette est chargee entierement en memoire
+  //(les octets ecrits sont reecrits par FlushMedia)
+  k7capacity = (size > 0) ? size : 1;
+  k7image = malloc(k7capacity);
+  if (k7image == NULL) return;
+  memcpy(k7image, data, size);
+  k7size = size;
+  k7pos = 0;
+  k7bit = 0;
+  k7indexed = false;
+  k7summed = false;
+  fk7 = open_writeback(filename);
+}
+
+void LoadTape(const char *filename)
+{
+  long size;
+  char *data;
+  if ((filename[0] == '\0') || ((data = vfs_read_file(filename, &size)) == NULL))
+  {
+    UnloadTape();
+    return;
+  }
+  LoadTapeFromArray(filename, data, size);
+  free(data);
 }
 
 void RewindTape(void)
 {
-  if (fk7 != NULL)
+  k7pos = 0;
+  k7bit = 0;
+}
+
+// Index of the files of the tape: the header blocks (type 0) of the
+// standard format (leader of 0x01 bytes, 0x3C 0x5A, type, length, name...)
+static void IndexTape(void)
+{
+  long p = 0, leader;
+  int i, j;
+  unsigned char *image = (unsigned char *) k7image;
+  TapeFile *file;
+  k7nfiles = 0;
+  k7indexed = true;
+  while ((p < k7size) && (k7nfiles < K7_MAX_FILES))
   {
-    if (fseek(fk7, 0, SEEK_SET)) UnloadTape();
+    if (image[p] != 0x01) {p++; continue;}
+    leader = p;
+    while ((p < k7size) && (image[p] == 0x01)) p++;
+    if ((p + 4 + K7_NAME_LENGTH > k7size) || (image[p] != 0x3c) || (image[p + 1] != 0x5a)
+        || (image[p + 2] != 0x00) || (image[p + 3] < K7_NAME_LENGTH + 2)) continue;
+    // name without the trailing spaces, then extension
+    file = &k7files[k7nfiles++];
+    file->pos = leader;
+    for (i = 0, j = 0; i < 8; i++) file->name[j++] = image[p + 4 + i];
+    while ((j > 0) && (file->name[j - 1] == ' ')) j--;
+    file->name[j++] = '.';
+    for (i = 8; i < K7_NAME_LENGTH; i++) file->name[j++] = image[p + 4 + i];
+    while (file->name[j - 1] == ' ') j--;
+    file->name[j] = '\0';
+    // non printable characters (protections...)
+    for (i = 0; i < j; i++) if ((file->name[i] < 0x20) || (file->name[i] > 0x7e)) file->name[i] = '?';
+    p += 4 + K7_NAME_LENGTH;
   }
 }
 
+int GetTapeFileCount(void)
+{
+  if (k7image == NULL) return 0;
+  if (!k7indexed) IndexTape();
+  return k7nfiles;
+}
+
+const char *GetTapeFileName(int index)
+{
+  if ((index < 0) || (index >= GetTapeFileCount())) return NULL;
+  return k7files[index].name;
+}
+
+int GetTapeFile(void)
+{
+  int i, n = GetTapeFileCount();
+  for (i = 0; (i < n) && (k7files[i].pos <= k7pos); i++);
+  return i - 1;
+}
+
+void SeekTapeFile(int index)
+{
+  if ((index < 0) || (index >= GetTapeFileCount())) return;
+  k7pos = k7files[index].pos;
+  k7bit = 0;
+}
+
 // Tape drive: read a byte
 static int ReadByteTape(void)
 {
   int byte = 0;
-  if(fk7 == NULL) {Initprog(); return 0;}
-  byte = fgetc(fk7);
-  if(byte == EOF)
+  if(k7image == NULL) {Initprog(); return 0;}
+  if(k7pos >= k7size)
   {
     Initprog();
     RewindTape();
     return 0;
   }
+  byte = k7image[k7pos++] & 0xff;
   if (is_to)
   {
     // B register will be popped from the stack and should contain the read byte
-    Mputc(dc6809_s+4, byte);
+    Mputc(S+4, byte);
   }
   else
   {
@@ -266,24 +608,84 @@ static int ReadByteTape(void)
   return byte;
 }
 
+// Tape drive: write a byte at the current position
+static bool PutByteTape(char byte)
+{
+  char *image;
+  if (k7pos >= k7capacity)
+  {
+    image = realloc(k7image, 2 * k7capacity);
+    if (image == NULL) return false;
+    k7image = image;
+    k7capacity *= 2;
+  }
+  k7image[k7pos] = byte;
+  if ((k7dirty < 0) || (k7pos < k7dirty)) k7dirty = k7pos;
+  k7indexed = false;
+  k7summed = false;
+  if (++k7pos > k7size) k7size = k7pos;
+  return true;
+}
+
 // Tape drive: write a byte
 static void WriteByteTape(void)
 {
-  if(fk7 == NULL) {Initprog(); return;}
+  if(k7image == NULL) {Initprog(); return;}
   if(k7protection) {Initprog(); return;}
   if (is_to)
   {
     // B register contains the byte to write
-    if(fputc(B, fk7) == EOF) {Initprog(); return;}
+    if(!PutByteTape(B)) {Initprog(); return;}
   }
   else
   {
     // A register contains the byte to write
-    if(fputc(A, fk7) == EOF) {Initprog(); return;}
+    if(!PutByteTape(A)) {Initprog(); return;}
     Mputc(0x2045, 0);
   }
 }
 
+// Tape fast loader: reads a whole standard block (leader of 0x01 bytes, 0x3C 0x5A,
+// type, length, data and checksum) the way the block read routine of the monitor does,
+// when the tape I/O opcode is the first one of this routine.
+// Returns false (and does nothing) otherwise, or if the block is not a standard one.
+static bool ReadBlockTape(void)
+{
+  long p = k7pos;
+  int type, length, count, i, byte, sum = 0;
+  unsigned short s = S;
+  if(!k7fastload || (k7block == NULL) || (k7image == NULL) || (k7bit != 0)) return false;
+  if((unsigned short) Mgetw(s) != k7block->sync_return) return false;
+  if((p >= k7size) || (k7image[p] != 0x01)) return false;
+  while((p < k7size) && (k7image[p] == 0x01)) p++;
+  if(p + 4 > k7size) return false;
+  if(((k7image[p] & 0xff) != 0x3c) || ((k7image[p + 1] & 0xff) != 0x5a)) return false;
+  type = k7image[p + 2] & 0xff;
+  length = k7image[p + 3] & 0xff;
+  count = (length - 1) & 0xff; // bytes after the length (the routine loops 256 times if 0)
+  if(p + 4 + count > k7size) return false;
+  p += 4;
+  // The length and the data are copied at Y, the checksum is the sum of the bytes read
+  Mputc(Y++, length);
+  byte = length;
+  for(i = 0; i < count; i++)
+  {
+    byte = k7image[p++] & 0xff;
+    Mputc(Y++, byte);
+    sum += byte;
+  }
+  k7pos = p;
+  Mputc(s + 6, type);
+  Mputc(s + 5, sum);
+  Mputc(0x2041, 0);     // remaining bytes
+  Mputc(0x2045, byte);  // last byte read
+  A = (count > 0) ? sum : length;
+  CC = (CC & 0xf1) | 0x04; // DEC of the remaining bytes: Z set
+  S = s + k7block->end_stack;
+  dc6809.pc.uw = k7block->end;
+  return true;
+}
+
 static void ReadBitTape(void)
 {
   int octet = Mgetc(0x2045) << 1;
@@ -298,25 +700,6 @@ void UnloadMemo(void)
   Hardreset();
 }
 
-void LoadMemo(const char *filename)
-{
-  FILE *fp = NULL;
-  int i, c, carsize;
-  // Open the memo7 file
-  fp = fopen(filename, "rb");
-  if(fp == NULL) {UnloadMemo(); return;}
-  // Loading
-  carsize = 0;
-  memset(car, 0, CARTRIDGE_MEM_SIZE);
-  while(((c = fgetc(fp)) != EOF) && (carsize < CARTRIDGE_MEM_SIZE)) car[carsize++] = c;
-  fclose(fp);
-  for(i = 0; i < 0xc000; i++) ram[i] = -((i & 0x80) >> 7);
-  cartype = 0; // cartridge <= 16 Ko
-  if(carsize > 0x4000) cartype = 1;   // bank switch system
-  carflags = 4; // cartridge enabled, write disabled, bank 0
-  Initprog();   // init to launch the cartridge
-}
-
 void LoadMemoFromArray(const char *rom, unsigned int rom_size)
 {
   unsigned int i, carsize;
@@ -335,6 +718,15 @@ void LoadMemoFromArray(const char *rom, unsigned int rom_size)
   Initprog();   // init to launch the cartridge
 }
 
+void LoadMemo(const char *filename)
+{
+  long size;
+  char *data = vfs_read_file(filename, &size);
+  if(data == NULL) {UnloadMemo(); return;}
+  LoadMemoFromArray(data, size);
+  free(data);
+}
+
 // Read the buttons of the mouse
 static void Readmousebutton(void)
 {
@@ -373,15 +765,15 @@ void RunIoOpcode(int opcode)
   // Here we support both the "old" (DCTO8D/DCTO9P/DCMO5) and "new" (dcmoto) "illegal" opcodes.
   switch(opcode)
   {
-    case 0x14: Readsector(); break;      // read floppy sector
-    case 0x15: Writesector(); break;     // write floppy sector
-    case 0x18: Formatdisk(); break;      // format floppy
+    case 0x14: Readsector(); mediaio++; break;      // read floppy sector
+    case 0x15: Writesector(); mediaio++; break;     // write floppy sector
+    case 0x18: Formatdisk(); mediaio++; break;      // format floppy
     case 0x11f0:
-    case 0x41: ReadBitTape(); break;     // read tape bit
+    case 0x41: if(!ReadBlockTape()) ReadBitTape(); mediaio++; break;  // read tape bit
     case 0x11f1:
-    case 0x42: ReadByteTape(); break;    // read tape byte
+    case 0x42: if(!ReadBlockTape()) ReadByteTape(); mediaio++; break; // read tape byte
     case 0x11f2:
-    case 0x45: WriteByteTape(); break;   // write tape byte
+    case 0x45: WriteByteTape(); mediaio++; break;   // write tape byte
     case 0x11f7:
     case 0x4b: Readpenxy(0); break;      // read light pen position
     case 0x11f8:
@@ -391,45 +783,82 @@ void RunIoOpcode(int opcode)
     case 0x11f9:
     case 0x52: Readmousebutton(); break; // test mouse click
     default:
-#ifdef THEODORE_DASM
       debugger_illegal_opcode();
-#endif
       break;                             // invalid opcode
   }
 }
 
+unsigned long GetMediaIoCount(void)
+{
+  return mediaio;
+}
+
+// Size of the RAM disk in the state (fixed for each model, 0 without RAM disk)
+static int ramdisk_state_size(void)
+{
+  return ramdisktracks * SECTORS_PER_TRACK * SECTOR_SIZE;
+}
+
+// Checksum (FNV-1a) of the content of the tape, computed again after a write
+static unsigned int TapeChecksum(void)
+{
+  long i;
+  if (!k7summed)
+  {
+    k7checksum = 2166136261u;
+    for (i = 0; i < k7size; i++) k7checksum = (k7checksum ^ (k7image[i] & 0xff)) * 16777619u;
+    k7summed = true;
+  }
+  return k7checksum;
+}
+
 unsigned int device_serialize_size(void)
 {
-  return sizeof(int) + sizeof(int);
+  return 5 * sizeof(int) + ramdisk_state_size();
 }
 
+// The position of the tape (and the bits of the current byte) are saved
+// even without tape, so that the size of the state does not depend on it,
+// with the size and the checksum of the tape: the content of the tape is
+// not in the state, so the position is only restored on the same content.
+// The disk in the drive and the used part of the RAM disk follow.
 void device_serialize(void *data)
 {
   char *buffer = (char *) data;
-  int k7data;
-  if (fk7 != NULL)
-  {
-    int offset = 0;
-    k7data = (k7octet << 8) + k7bit;
-    memcpy(buffer+offset, &k7data, sizeof(int));
-    offset += sizeof(int);
-    k7data = (int) ftell(fk7);
-    memcpy(buffer+offset, &k7data, sizeof(int));
-  }
+  int offset = 0;
+  int k7data[4];
+  int disk = GetFloppy();
+  k7data[0] = (k7octet << 8) + k7bit;
+  k7data[1] = (k7image != NULL) ? (int) k7pos : 0;
+  k7data[2] = (k7image != NULL) ? (int) k7size : -1;
+  k7data[3] = (k7image != NULL) ? (int) TapeChecksum() : 0;
+  memcpy(buffer+offset, k7data, sizeof(k7data));
+  offset += sizeof(k7data);
+  memcpy(buffer+offset, &disk, sizeof(int));
+  offset += sizeof(int);
+  memcpy(buffer+offset, ramdisk, ramdisk_state_size());
 }
 
 void device_unserialize(const void *data)
 {
   char *buffer = (char *) data;
-  int k7data;
-  if (fk7 != NULL)
+  int offset = 0;
+  int k7data[4], disk;
+  memcpy(k7data, buffer+offset, sizeof(k7data));
+  offset += sizeof(k7data);
+  if ((k7image != NULL) && ((k7data[2] != (int) k7size)
+      || ((unsigned int) k7data[3] != TapeChecksum()) || (k7data[1] < 0) || (k7data[1] > k7size)))
+  {
+    LOG_WARN("The state was saved with another tape content: the tape position is not restored.\n");
+  }
+  else
   {
-    int offset = 0;
-    memcpy(&k7data, buffer+offset, sizeof(int));
-    offset += sizeof(int);
-    k7octet = (k7data >> 8) & 0xFF;
-    k7bit = k7data & 0xFF;
-    memcpy(&k7data, buffer+offset, sizeof(int));
-    fseek(fk7, k7data, SEEK_SET);
+    k7octet = (k7data[0] >> 8) & 0xFF;
+    k7bit = k7data[0] & 0xFF;
+    if (k7image != NULL) k7pos = k7data[1];
   }
+  memcpy(&disk, buffer+offset, sizeof(int));
+  offset += sizeof(int);
+  InsertFloppy(disk);
+  memcpy(ramdisk, buffer+offset, ramdisk_state_size());
 }
@@ -27,6 +27,29 @@
 // Set the MO/TO mode: true = TO, false = MO
 void SetModeTO(bool isTO);
 
+// Block read routine of the monitor, used by the tape fast loader.
+// The routine starts with a tape I/O opcode called by a BSR, the type of
+// the block and the checksum are at 6,S and 5,S (S being the one of this opcode).
+typedef struct
+{
+  unsigned short sync_return; // return address of the first tape I/O opcode of the routine
+  unsigned short end;         // address of the end of the routine once the block is read
+  int end_stack;              // value added to S to get the stack pointer at address end
+} TapeBlockRoutine;
+
+// Set the block read routine of the monitor (NULL if the monitor has none)
+void SetTapeBlockRoutine(const TapeBlockRoutine *routine);
+// Enable or disable the tape fast loader
+void SetTapeFastLoad(bool enabled);
+// Set the size of the RAM disk (drive 4) in tracks of 16 sectors (0: no RAM disk).
+// The RAM disk is formatted (or filled with the floppy disk if the preload is enabled).
+void SetRamDiskSize(int tracks);
+// Enable or disable the copy of the first side of the floppy disk to the RAM disk
+// when a floppy disk is loaded
+void SetRamDiskPreload(bool enabled);
+// Copy the first side of the floppy disk in the drive to the RAM disk if the preload
+// is enabled (done when a floppy disk is loaded)
+void PreloadRamDisk(void);
 // Set or unset the floppy's write protection
 void SetFloppyWriteProtect(bool enabled);
 // Set or unset the tape's write protection
@@ -40,23 +63,52 @@ void LoadFd(const char *filename);
 void LoadSap(const char *filename);
 // Load a tape
 void LoadTape(const char *filename);
+// Load a floppy disk (fd or sap format) or a tape from the content of its file
+// (the modifications are written back to the file 'filename' when it is writable)
+void LoadFdFromArray(const char *filename, const char *data, long size);
+void LoadSapFromArray(const char *filename, const char *data, long size);
+void LoadTapeFromArray(const char *filename, const char *data, long size);
+// Multi-disk sets: the disks are loaded in memory and added to the set,
+// then one of them is inserted in the drive (swapping disks is instantaneous).
+// The Load functions replace the set by a single disk inserted in the drive.
+#define FLOPPY_MAX_DISKS 16
+bool AddFdFromArray(const char *filename, const char *data, long size);
+bool AddSapFromArray(const char *filename, const char *data, long size);
+// Number of disks of the set
+int GetFloppyCount(void);
+// Index of the disk in the drive (-1 if the drive is empty)
+int GetFloppy(void);
+// Insert a disk of the set in the drive (-1: eject the disk)
+void InsertFloppy(int index);
 // Load a memo7 cartridge
 void LoadMemo(const char *filename);
 // Load a memo7 cartridge from an array
 void LoadMemoFromArray(const char *rom, unsigned int rom_size);
-// Unload the floppy disk
+// Unload the floppy disks (the modified sectors are written back to the files)
 void UnloadFloppy(void);
-// Unload the tape
+// Write the modifications of the floppy disks and of the tape back to their files
+void FlushMedia(void);
+// Unload the tape (the data written is saved to the file)
 void UnloadTape(void);
 // Unload the cartridge
 void UnloadMemo(void);
 // Rewind the tape
 void RewindTape(void);
+// Index of the files of the tape (built from their header blocks):
+// number of files, name of a file ("NAME.EXT"), file at the current position
+// of the tape (-1 if before the first one) and positioning at the start of a file
+int GetTapeFileCount(void);
+const char *GetTapeFileName(int index);
+int GetTapeFile(void);
+void SeekTapeFile(int index);
 
 // Run an input/output related opcode.
 // These "wrong" opcodes come from the patching of the ROM
 // and are used to emulate I/O functions of the monitor.
 void RunIoOpcode(int opcode);
+// Number of tape and floppy disk I/O opcodes run since the start
+// (used to detect the loadings)
+unsigned long GetMediaIoCount(void);
 
 // The following functions are used for libretro's save states feature.
 // Returns the amount of data required to serialize the internal state of the device module.
@@ -0,0 +1,722 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* GDB remote serial protocol server for the emulated 6809.
+ * The client connects to a TCP port of the local host and drives the
+ * debugger in remote mode: registers, memory, step, continue, breakpoints
+ * (Z0/Z1) and watchpoints (Z2/Z3/Z4) use the remote breakpoints of debugger.c.
+ * The socket is polled once per frame and never blocks the emulation;
+ * while the client holds the CPU stopped, the frames are still produced. */
+
+#if defined(HAVE_GDBSTUB) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+#endif
+
+#include "gdbstub.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "6809cpu.h"
+#include "debugger.h"
+#include "logger.h"
+#include "motoemulator.h"
+
+#ifdef HAVE_GDBSTUB
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define PACKET_SIZE     4096
+#define NB_REGISTERS    9
+#define MAX_BREAKPOINTS 64
+
+// Description of the registers sent to the client (order of the g/G packets)
+static const char target_xml[] =
+  "<?xml version=\"1.0\"?>"
+  "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+  "<target version=\"1.0\">"
+  "<feature name=\"org.gnu.gdb.m6809.core\">"
+  "<reg name=\"cc\" bitsize=\"8\" type=\"uint8\"/>"
+  "<reg name=\"a\" bitsize=\"8\" type=\"uint8\"/>"
+  "<reg name=\"b\" bitsize=\"8\" type=\"uint8\"/>"
+  "<reg name=\"dp\" bitsize=\"8\" type=\"uint8\"/>"
+  "<reg name=\"x\" bitsize=\"16\" type=\"uint16\"/>"
+  "<reg name=\"y\" bitsize=\"16\" type=\"uint16\"/>"
+  "<reg name=\"u\" bitsize=\"16\" type=\"data_ptr\"/>"
+  "<reg name=\"s\" bitsize=\"16\" type=\"data_ptr\"/>"
+  "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+  "</feature>"
+  "</target>";
+
+static int server = -1;
+static int client = -1;
+static int serverport = 0;
+static bool noack = false;         // QStartNoAckMode
+static bool halted = false;        // emulation stopped by the client
+static bool resuming = false;      // first instruction after c or s (never stopped)
+static bool stepping = false;
+static int stopsignal = 0;         // stop requested after the current instruction
+static char stopwatch[32];         // watchpoint part of the stop reply
+static bool clientaccess = false;  // memory written by the client (not watched)
+
+static DebuggerMode previousmode = DEBUG_DISABLED; // restored on disconnect
+
+// Breakpoints and watchpoints set by the client (Z packets): an address stays
+// in the breakpoints of debugger.c while one of them covers it
+typedef struct
+{
+  int type;
+  unsigned short address;
+  unsigned long length;
+} Breakpoint;
+static Breakpoint breakpoints[MAX_BREAKPOINTS];
+static int nbreakpoints = 0;
+
+static char input[PACKET_SIZE];
+static int inputlength = 0;
+static char reply[2 * PACKET_SIZE];
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static int hexvalue(char c)
+{
+  if ((c >= '0') && (c <= '9')) return c - '0';
+  if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+  if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+  return -1;
+}
+
+// Reads an hexadecimal number and moves the pointer after it
+static unsigned long parse_hex(const char **p)
+{
+  unsigned long value = 0;
+  while (hexvalue(**p) >= 0)
+  {
+    value = (value << 4) | hexvalue(**p);
+    (*p)++;
+  }
+  return value;
+}
+
+static void put_hex(char *p, int value, int bytes)
+{
+  int i;
+  for (i = 2 * bytes - 1; i >= 0; i--)
+  {
+    *p++ = hexdigits[(value >> (4 * i)) & 0x0f];
+  }
+  *p = 0;
+}
+
+// Registers ////////////////////////////////////////////////////////////////
+static int register_size(int n)
+{
+  return (n < 4) ? 1 : 2;
+}
+
+static int get_register(int n)
+{
+  switch (n)
+  {
+    case 0: return dc6809.cc & 0xff;
+    case 1: return dc6809.d.b.h & 0xff;
+    case 2: return dc6809.d.b.l & 0xff;
+    case 3: return dc6809.da.b.h & 0xff;
+    case 4: return dc6809.x.uw;
+    case 5: return dc6809.y.uw;
+    case 6: return dc6809.u.uw;
+    case 7: return dc6809.s.uw;
+    default: return dc6809.pc.uw;
+  }
+}
+
+static void set_register(int n, int value)
+{
+  switch (n)
+  {
+    case 0: dc6809.cc = value; break;
+    case 1: dc6809.d.b.h = value; break;
+    case 2: dc6809.d.b.l = value; break;
+    case 3: dc6809.da.b.h = value; break;
+    case 4: dc6809.x.uw = value; break;
+    case 5: dc6809.y.uw = value; break;
+    case 6: dc6809.u.uw = value; break;
+    case 7: dc6809.s.uw = value; break;
+    default: dc6809.pc.uw = value; break;
+  }
+}
+
+// Connection ///////////////////////////////////////////////////////////////
+static void send_data(const char *data, int length)
+{
+  while ((length > 0) && (client >= 0))
+  {
+    int n = send(client, data, length, MSG_NOSIGNAL);
+    if (n > 0)
+    {
+      data += n;
+      length -= n;
+    }
+    else if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+    {
+      return;
+    }
+  }
+}
+
+static void send_packet(const char *payload)
+{
+  static char packet[2 * PACKET_SIZE + 4];
+  unsigned char checksum = 0;
+  int i, n = 0;
+  packet[n++] = '$';
+  for (i = 0; payload[i] && (n < 2 * PACKET_SIZE); i++)
+  {
+    checksum += (unsigned char) payload[i];
+    packet[n++] = payload[i];
+  }
+  packet[n++] = '#';
+  packet[n++] = hexdigits[checksum >> 4];
+  packet[n++] = hexdigits[checksum & 0x0f];
+  send_data(packet, n);
+}
+
+static void close_client(void)
+{
+  close(client);
+  client = -1;
+  halted = false;
+  nbreakpoints = 0;
+  debugger_clear_breakpoints(BP_REMOTE);
+  debugger_setMode(previousmode);
+  LOG_INFO("GDB client disconnected.\n");
+}
+
+static void accept_client(void)
+{
+  int one = 1;
+  int fd = accept(server, NULL, NULL);
+  if (fd < 0) return;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef TCP_NODELAY
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *) &one, sizeof(one));
+#endif
+  client = fd;
+  noack = false;
+  inputlength = 0;
+  // The client expects a stopped target
+  halted = true;
+  resuming = stepping = false;
+  stopsignal = 0;
+  stopwatch[0] = 0;
+  previousmode = debugger_getMode();
+  debugger_setMode(DEBUG_REMOTE);
+  LOG_INFO("GDB client connected.\n");
+}
+
+// Stops the emulation and reports it to the client
+static void stop(int signal)
+{
+  halted = true;
+  stepping = false;
+  if (stopwatch[0])
+  {
+    sprintf(reply, "T%02x%s", signal, stopwatch);
+  }
+  else
+  {
+    sprintf(reply, "S%02x", signal);
+  }
+  stopsignal = 0;
+  stopwatch[0] = 0;
+  send_packet(reply);
+}
+
+static void resume(bool step, const char *address)
+{
+  if (*address) dc6809.pc.uw = parse_hex(&address);
+  halted = false;
+  resuming = true;
+  stepping = step;
+}
+
+// Packets //////////////////////////////////////////////////////////////////
+static void read_registers(void)
+{
+  int n;
+  char *p = reply;
+  for (n = 0; n < NB_REGISTERS; n++)
+  {
+    put_hex(p, get_register(n), register_size(n));
+    p += 2 * register_size(n);
+  }
+  send_packet(reply);
+}
+
+static void write_registers(const char *p)
+{
+  int n, i, value;
+  for (n = 0; n < NB_REGISTERS; n++)
+  {
+    value = 0;
+    for (i = 0; i < 2 * register_size(n); i++)
+    {
+      if (hexvalue(*p) < 0)
+      {
+        send_packet("E01");
+        return;
+      }
+      value = (value << 4) | hexvalue(*p++);
+    }
+    set_register(n, value);
+  }
+  send_packet("OK");
+}
+
+static void read_register(const char *p)
+{
+  int n = parse_hex(&p);
+  if (n >= NB_REGISTERS)
+  {
+    send_packet("E01");
+    return;
+  }
+  put_hex(reply, get_register(n), register_size(n));
+  send_packet(reply);
+}
+
+static void write_register(const char *p)
+{
+  int n = parse_hex(&p);
+  if ((n >= NB_REGISTERS) || (*p++ != '='))
+  {
+    send_packet("E01");
+    return;
+  }
+  set_register(n, parse_hex(&p));
+  send_packet("OK");
+}
+
+// The reads with side effects (I/O ports) are not done: they return 0
+static void read_memory(const char *p)
+{
+  unsigned short a = parse_hex(&p);
+  unsigned long length;
+  unsigned long i;
+  if (*p++ != ',')
+  {
+    send_packet("E01");
+    return;
+  }
+  length = parse_hex(&p);
+  if (length > PACKET_SIZE / 2) length = PACKET_SIZE / 2;
+  for (i = 0; i < length; i++, a++)
+  {
+    put_hex(reply + 2 * i, Mpeek(a) & 0xff, 1);
+  }
+  reply[2 * length] = 0;
+  send_packet(reply);
+}
+
+static void write_memory(const char *p)
+{
+  unsigned short a = parse_hex(&p);
+  unsigned long length;
+  if (*p++ != ',')
+  {
+    send_packet("E01");
+    return;
+  }
+  length = parse_hex(&p);
+  if (*p++ != ':')
+  {
+    send_packet("E01");
+    return;
+  }
+  clientaccess = true;
+  while ((length-- > 0) && (hexvalue(p[0]) >= 0) && (hexvalue(p[1]) >= 0))
+  {
+    Mputc(a++, (hexvalue(p[0]) << 4) | hexvalue(p[1]));
+    p += 2;
+  }
+  clientaccess = false;
+  send_packet("OK");
+}
+
+// True if the breakpoint covers the given kind of access at the given address
+static bool covers(const Breakpoint *b, BreakpointKind kind, unsigned short a)
+{
+  switch (kind)
+  {
+    case BP_PC:
+      return (b->type <= 1) && (b->address == a);
+    case BP_READ:
+      return ((b->type == 3) || (b->type == 4)) && ((unsigned short) (a - b->address) < b->length);
+    case BP_WRITE:
+      return ((b->type == 2) || (b->type == 4)) && ((unsigned short) (a - b->address) < b->length);
+    default:
+      return false;
+  }
+}
+
+// Updates the breakpoints of debugger.c in the range of the breakpoint b
+static void update_breakpoints(const Breakpoint *b)
+{
+  unsigned long n;
+  unsigned short a = b->address;
+  int kind, i;
+  bool set;
+  for (n = (b->type <= 1) ? 1 : b->length; n > 0; n--, a++)
+  {
+    for (kind = BP_PC; kind < BP_KINDS; kind++)
+    {
+      for (i = 0, set = false; (i < nbreakpoints) && !set; i++)
+      {
+        set = covers(&breakpoints[i], kind, a);
+      }
+      debugger_set_breakpoint(BP_REMOTE, kind, a, set);
+    }
+  }
+}
+
+// Z/z packets: type 0 or 1 = breakpoint, 2 = write, 3 = read, 4 = access watchpoint
+// (the same breakpoint can be set several times, e.g. by overlapping watchpoints)
+static void set_breakpoint(const char *p, bool set)
+{
+  Breakpoint b;
+  int i;
+  b.type = parse_hex(&p);
+  b.length = 1;
+  if ((b.type > 4) || (*p++ != ','))
+  {
+    send_packet("");
+    return;
+  }
+  b.address = parse_hex(&p);
+  if (*p++ == ',') b.length = parse_hex(&p);
+  if (b.length > 0x10000) b.length = 0x10000;
+  if (set)
+  {
+    if (nbreakpoints == MAX_BREAKPOINTS)
+    {
+      send_packet("E01");
+      return;
+    }
+    breakpoints[nbreakpoints++] = b;
+  }
+  else
+  {
+    for (i = 0; i < nbreakpoints; i++)
+    {
+      if ((breakpoints[i].type == b.type) && (breakpoints[i].address == b.address)
+          && ((b.type <= 1) || (breakpoints[i].length == b.length))) break;
+    }
+    if (i < nbreakpoints)
+    {
+      breakpoints[i] = breakpoints[--nbreakpoints];
+    }
+  }
+  update_breakpoints(&b);
+  send_packet("OK");
+}
+
+// qXfer:features:read:target.xml:offset,length
+static void read_target_xml(const char *p)
+{
+  unsigned long offset, length, size = sizeof(target_xml) - 1;
+  offset = parse_hex(&p);
+  if (*p++ != ',')
+  {
+    send_packet("E01");
+    return;
+  }
+  length = parse_hex(&p);
+  if (length > PACKET_SIZE - 2) length = PACKET_SIZE - 2;
+  if (offset >= size)
+  {
+    send_packet("l");
+    return;
+  }
+  if (offset + length >= size)
+  {
+    length = size - offset;
+    reply[0] = 'l';
+  }
+  else
+  {
+    reply[0] = 'm';
+  }
+  memcpy(reply + 1, target_xml + offset, length);
+  reply[length + 1] = 0;
+  send_packet(reply);
+}
+
+static void handle_query(const char *p)
+{
+  if (strncmp(p, "qSupported", 10) == 0)
+  {
+    sprintf(reply, "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+", PACKET_SIZE);
+    send_packet(reply);
+  }
+  else if (strncmp(p, "qXfer:features:read:target.xml:", 31) == 0) read_target_xml(p + 31);
+  else if (strcmp(p, "qAttached") == 0) send_packet("1");
+  else if (strcmp(p, "qC") == 0) send_packet("QC1");
+  else if (strcmp(p, "qfThreadInfo") == 0) send_packet("m1");
+  else if (strcmp(p, "qsThreadInfo") == 0) send_packet("l");
+  else if (strncmp(p, "qSymbol", 7) == 0) send_packet("OK");
+  else send_packet("");
+}
+
+static void handle_packet(const char *p)
+{
+  switch (p[0])
+  {
+    case '?': sprintf(reply, "S%02x", GDB_SIGNAL_TRAP); send_packet(reply); break;
+    case 'g': read_registers(); break;
+    case 'G': write_registers(p + 1); break;
+    case 'p': read_register(p + 1); break;
+    case 'P': write_register(p + 1); break;
+    case 'm': read_memory(p + 1); break;
+    case 'M': write_memory(p + 1); break;
+    case 'c': resume(false, p + 1); break;
+    case 's': resume(true, p + 1); break;
+    case 'Z': set_breakpoint(p + 1, true); break;
+    case 'z': set_breakpoint(p + 1, false); break;
+    case 'H': case 'T': send_packet("OK"); break;
+    case 'q': handle_query(p); break;
+    case 'Q':
+      if (strcmp(p, "QStartNoAckMode") == 0)
+      {
+        send_packet("OK");
+        noack = true;
+      }
+      else send_packet("");
+      break;
+    case 'D': send_packet("OK"); close_client(); break;
+    case 'k': close_client(); break;
+    default:
+      if (strcmp(p, "vKill;1") == 0)
+      {
+        send_packet("OK");
+        close_client();
+      }
+      else send_packet("");
+      break;
+  }
+}
+
+// Splits the received data into packets ($payload#checksum) and interrupts (0x03)
+static void process_input(void)
+{
+  int i = 0, end, j;
+  unsigned char checksum;
+  while ((i < inputlength) && (client >= 0))
+  {
+    if (input[i] == 0x03)
+    {
+      i++;
+      if (!halted) stop(GDB_SIGNAL_INT);
+      continue;
+    }
+    // Acknowledgements and noise
+    if (input[i] != '$')
+    {
+      i++;
+      continue;
+    }
+    for (end = i + 1; (end < inputlength) && (input[end] != '#'); end++);
+    if (end + 2 >= inputlength) break; // incomplete packet
+    checksum = 0;
+    for (j = i + 1; j < end; j++) checksum += (unsigned char) input[j];
+    if ((hexvalue(input[end + 1]) << 4 | hexvalue(input[end + 2])) != checksum)
+    {
+      if (!noack) send_data("-", 1);
+    }
+    else
+    {
+      if (!noack) send_data("+", 1);
+      input[end] = 0;
+      handle_packet(input + i + 1);
+    }
+    i = end + 3;
+  }
+  if (client < 0) return;
+  memmove(input, input + i, inputlength - i);
+  inputlength -= i;
+  // Packet too long: dropped
+  if (inputlength == PACKET_SIZE) inputlength = 0;
+}
+
+// Public interface /////////////////////////////////////////////////////////
+void gdbstub_start(int port)
+{
+  int one = 1;
+  struct sockaddr_in address;
+  if ((server >= 0) && (port == serverport)) return;
+  gdbstub_stop();
+  server = socket(AF_INET, SOCK_STREAM, 0);
+  if (server < 0)
+  {
+    LOG_ERROR("Cannot create the socket of the GDB server.\n");
+    return;
+  }
+  setsockopt(server, SOL_SOCKET, SO_REUSEADDR, (const char *) &one, sizeof(one));
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((bind(server, (struct sockaddr *) &address, sizeof(address)) < 0) || (listen(server, 1) < 0))
+  {
+    LOG_ERROR("Cannot listen on port %d for GDB.\n", port);
+    close(server);
+    server = -1;
+    return;
+  }
+  fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK);
+  serverport = port;
+  LOG_INFO("Waiting for GDB on port %d (target remote localhost:%d).\n", port, port);
+}
+
+void gdbstub_stop(void)
+{
+  if (client >= 0) close_client();
+  if (server >= 0) close(server);
+  server = -1;
+}
+
+void gdbstub_poll(void)
+{
+  int n;
+  if (server < 0) return;
+  if (client < 0)
+  {
+    accept_client();
+    if (client < 0) return;
+  }
+  while (client >= 0)
+  {
+    n = recv(client, input + inputlength, PACKET_SIZE - inputlength, 0);
+    if (n > 0)
+    {
+      inputlength += n;
+      process_input();
+    }
+    else
+    {
+      if ((n == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+      {
+        close_client();
+      }
+      break;
+    }
+  }
+}
+
+bool gdbstub_connected(void)
+{
+  return client >= 0;
+}
+
+bool gdbstub_instruction(bool breakpoint)
+{
+  if (halted) return false;
+  if (resuming)
+  {
+    resuming = false;
+    return true;
+  }
+  if (stopsignal)
+  {
+    stop(stopsignal);
+    return false;
+  }
+  if (stepping || breakpoint)
+  {
+    stop(GDB_SIGNAL_TRAP);
+    return false;
+  }
+  return true;
+}
+
+void gdbstub_watchpoint(unsigned short address, bool is_read)
+{
+  bool access = false;
+  int i;
+  if (clientaccess || halted || stopsignal) return;
+  for (i = 0; i < nbreakpoints; i++)
+  {
+    if ((breakpoints[i].type == 4) && covers(&breakpoints[i], is_read ? BP_READ : BP_WRITE, address))
+    {
+      access = true;
+    }
+  }
+  sprintf(stopwatch, "%s:%04x;", access ? "awatch" : (is_read ? "rwatch" : "watch"), address);
+  stopsignal = GDB_SIGNAL_TRAP;
+}
+
+void gdbstub_break(int signal)
+{
+  if (!halted && !stopsignal) stopsignal = signal;
+}
+
+#else
+
+// Builds without sockets
+void gdbstub_start(int port)
+{
+  (void) port;
+}
+
+void gdbstub_stop(void) {}
+void gdbstub_poll(void) {}
+
+bool gdbstub_connected(void)
+{
+  return false;
+}
+
+bool gdbstub_instruction(bool breakpoint)
+{
+  (void) breakpoint;
+  return true;
+}
+
+void gdbstub_watchpoint(unsigned short address, bool is_read)
+{
+  (void) address;
+  (void) is_read;
+}
+
+void gdbstub_break(int signal)
+{
+  (void) signal;
+}
+
+#endif /* HAVE_GDBSTUB */
@@ -0,0 +1,52 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* GDB remote serial protocol server for the emulated 6809 */
+
+#ifndef __GDBSTUB_H
+#define __GDBSTUB_H
+
+#include "boolean.h"
+
+// Signals reported to the client when the emulation stops
+#define GDB_SIGNAL_INT  2  // interrupted by the client
+#define GDB_SIGNAL_ILL  4  // illegal opcode
+#define GDB_SIGNAL_TRAP 5  // breakpoint, watchpoint or single step
+
+/* Listens for a GDB client on the given TCP port of the local host
+ * (only available in the builds with HAVE_GDBSTUB). */
+void gdbstub_start(int port);
+/* Closes the connection and stops listening. */
+void gdbstub_stop(void);
+/* Accepts the client and handles its packets without blocking
+ * (called once per frame). */
+void gdbstub_poll(void);
+/* True while a client is connected (the debugger is then in remote mode). */
+bool gdbstub_connected(void);
+
+/* Called by the debugger in remote mode before each instruction ("breakpoint"
+ * is true if a breakpoint is set at its address).
+ * Returns false if the emulation must stop before executing it. */
+bool gdbstub_instruction(bool breakpoint);
+/* Called by the debugger in remote mode on a watched memory access
+ * (the emulation stops after the current instruction). */
+void gdbstub_watchpoint(unsigned short address, bool is_read);
+/* Stops the emulation after the current instruction with the given signal. */
+void gdbstub_break(int signal);
+
+#endif /* __GDBSTUB_H */
@@ -0,0 +1,217 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Memory access heatmap.
+ * The reads, writes and executes are counted for each 256-byte page of the
+ * physical memory spaces (RAM, cartridge, ROMs), through the mapping of the
+ * banks at the time of the access. The reads include the opcode fetches and
+ * the executes count the instructions starting in the page. */
+
+#include "heatmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "logger.h"
+#include "motoemulator.h"
+
+#define PAGE_SHIFT 8
+// Maximum number of pages of a space (the RAM is the largest one)
+#define MAX_PAGES  (RAM_SIZE >> PAGE_SHIFT)
+// Pages of a 16 KB bank (one row of the image)
+#define BANK_PAGES 64
+
+// Size of a page of the image, with a 1 pixel grid
+#define CELL_SIZE  8
+#define GRID_COLOR 0x30
+
+typedef enum { ACCESS_READ, ACCESS_WRITE, ACCESS_EXECUTE, ACCESS_COUNT } AccessType;
+
+typedef unsigned long PageCounts[ACCESS_COUNT];
+
+static const char *space_names[SPACE_COUNT] = { "ram", "cartridge", "basic", "monitor", "disk" };
+
+bool heatmapping = false;
+
+static PageCounts *counts = NULL;  // SPACE_COUNT * MAX_PAGES pages
+
+static void count(unsigned short a, AccessType type)
+{
+  MemorySpace space;
+  int offset;
+  if (PhysicalAddress(a, &space, &offset))
+    counts[space * MAX_PAGES + (offset >> PAGE_SHIFT)][type]++;
+}
+
+void heatmap_read(unsigned short a)
+{
+  count(a, ACCESS_READ);
+}
+
+void heatmap_write(unsigned short a)
+{
+  count(a, ACCESS_WRITE);
+}
+
+void heatmap_execute(unsigned short a)
+{
+  count(a, ACCESS_EXECUTE);
+}
+
+void heatmap_start(void)
+{
+  if (heatmapping) return;
+  counts = calloc(SPACE_COUNT * MAX_PAGES, sizeof(PageCounts));
+  if (counts == NULL)
+  {
+    LOG_ERROR("Not enough memory for the heatmap.\n");
+    return;
+  }
+  heatmapping = true;
+  UpdateInstrumentation();
+}
+
+static int space_pages(MemorySpace space)
+{
+  int pages = (MemorySpaceSize(space) + (1 << PAGE_SHIFT) - 1) >> PAGE_SHIFT;
+  return (pages < MAX_PAGES) ? pages : MAX_PAGES;
+}
+
+static bool is_used(const PageCounts c)
+{
+  return (c[ACCESS_READ] | c[ACCESS_WRITE] | c[ACCESS_EXECUTE]) != 0;
+}
+
+static void write_table(const char *filename)
+{
+  int space, page, bank, used, npages;
+  unsigned long total[ACCESS_COUNT];
+  PageCounts *c;
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) return;
+  fprintf(fp, "# Accesses per 256-byte page of the physical memory\n");
+  fprintf(fp, "# (reads include the opcode fetches, executes count the instructions)\n");
+  fprintf(fp, "\n# bank usage (16 KB banks)\n# space bank used_pages reads writes executes\n");
+  for (space = 0; space < SPACE_COUNT; space++)
+  {
+    npages = space_pages(space);
+    for (bank = 0; bank * BANK_PAGES < npages; bank++)
+    {
+      used = 0;
+      total[ACCESS_READ] = total[ACCESS_WRITE] = total[ACCESS_EXECUTE] = 0;
+      for (page = bank * BANK_PAGES; (page < (bank + 1) * BANK_PAGES) && (page < npages); page++)
+      {
+        c = &counts[space * MAX_PAGES + page];
+        if (is_used(*c)) used++;
+        total[ACCESS_READ] += (*c)[ACCESS_READ];
+        total[ACCESS_WRITE] += (*c)[ACCESS_WRITE];
+        total[ACCESS_EXECUTE] += (*c)[ACCESS_EXECUTE];
+      }
+      fprintf(fp, "%s %d %d %lu %lu %lu\n", space_names[space], bank, used,
+              total[ACCESS_READ], total[ACCESS_WRITE], total[ACCESS_EXECUTE]);
+    }
+  }
+  fprintf(fp, "\n# pages\n# space offset reads writes executes\n");
+  for (space = 0; space < SPACE_COUNT; space++)
+  {
+    npages = space_pages(space);
+    for (page = 0; page < npages; page++)
+    {
+      c = &counts[space * MAX_PAGES + page];
+      fprintf(fp, "%s %05X %lu %lu %lu\n", space_names[space], page << PAGE_SHIFT,
+              (*c)[ACCESS_READ], (*c)[ACCESS_WRITE], (*c)[ACCESS_EXECUTE]);
+    }
+  }
+  fclose(fp);
+}
+
+static int bit_length(unsigned long n)
+{
+  int bits = 0;
+  while (n != 0) { bits++; n >>= 1; }
+  return bits;
+}
+
+// Logarithmic scale of the counts (0 stays black)
+static int intensity(unsigned long n, int maxbits)
+{
+  return (n == 0) ? 0 : 64 + 191 * bit_length(n) / maxbits;
+}
+
+// Image with red = writes, green = reads and blue = executes
+static void write_image(const char *filename)
+{
+  int space, row, x, y, page, type, npages, height;
+  int maxbits[ACCESS_COUNT] = { 1, 1, 1 };
+  unsigned char pixel[3];
+  PageCounts *c;
+  FILE *fp;
+  height = 0;
+  for (space = 0; space < SPACE_COUNT; space++)
+  {
+    npages = space_pages(space);
+    if (npages == 0) continue;
+    height += ((npages + BANK_PAGES - 1) / BANK_PAGES + 1) * CELL_SIZE;
+    for (page = 0; page < npages; page++)
+      for (type = 0; type < ACCESS_COUNT; type++)
+        if (bit_length(counts[space * MAX_PAGES + page][type]) > maxbits[type])
+          maxbits[type] = bit_length(counts[space * MAX_PAGES + page][type]);
+  }
+  fp = fopen(filename, "wb");
+  if (fp == NULL) return;
+  fprintf(fp, "P6\n%d %d\n255\n", BANK_PAGES * CELL_SIZE, height);
+  for (space = 0; space < SPACE_COUNT; space++)
+  {
+    npages = space_pages(space);
+    if (npages == 0) continue;
+    // One row of cells per bank, then a black row between the spaces
+    for (row = 0; row <= (npages + BANK_PAGES - 1) / BANK_PAGES; row++)
+    {
+      for (y = 0; y < CELL_SIZE; y++)
+        for (x = 0; x < BANK_PAGES * CELL_SIZE; x++)
+        {
+          page = row * BANK_PAGES + x / CELL_SIZE;
+          if (page >= npages)
+            pixel[0] = pixel[1] = pixel[2] = 0;
+          else if ((y == CELL_SIZE - 1) || (x % CELL_SIZE == CELL_SIZE - 1))
+            pixel[0] = pixel[1] = pixel[2] = GRID_COLOR;
+          else
+          {
+            c = &counts[space * MAX_PAGES + page];
+            pixel[0] = intensity((*c)[ACCESS_WRITE], maxbits[ACCESS_WRITE]);
+            pixel[1] = intensity((*c)[ACCESS_READ], maxbits[ACCESS_READ]);
+            pixel[2] = intensity((*c)[ACCESS_EXECUTE], maxbits[ACCESS_EXECUTE]);
+          }
+          fwrite(pixel, 1, sizeof(pixel), fp);
+        }
+    }
+  }
+  fclose(fp);
+}
+
+void heatmap_stop(void)
+{
+  if (!heatmapping) return;
+  heatmapping = false;
+  write_table(HEATMAP_TABLE_FILE);
+  write_image(HEATMAP_IMAGE_FILE);
+  LOG_INFO("Heatmap written to %s and %s.\n", HEATMAP_TABLE_FILE, HEATMAP_IMAGE_FILE);
+  free(counts);
+  counts = NULL;
+  UpdateInstrumentation();
+}
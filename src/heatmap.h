@@ -0,0 +1,47 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Memory access heatmap */
+
+#ifndef __HEATMAP_H
+#define __HEATMAP_H
+
+#include "boolean.h"
+
+// Files written when the heatmap is stopped
+#define HEATMAP_TABLE_FILE "theodore-heatmap.txt"
+#define HEATMAP_IMAGE_FILE "theodore-heatmap.ppm"
+
+// True while the accesses are counted (Run() then uses its instrumented loop)
+extern bool heatmapping;
+
+/* Starts counting the accesses to each 256-byte page of the physical memory. */
+void heatmap_start(void);
+/* Stops counting and writes the heatmap:
+ * - table of the reads, writes and executes of each page, with the usage of
+ *   each 16 KB bank,
+ * - image (one cell per page, one row per 16 KB bank). */
+void heatmap_stop(void);
+
+/* Counts a read or a write at a logical address (with the current banks). */
+void heatmap_read(unsigned short a);
+void heatmap_write(unsigned short a);
+/* Counts the execution of an instruction at a logical address. */
+void heatmap_execute(unsigned short a);
+
+#endif /* __HEATMAP_H */
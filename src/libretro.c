@@ -24,14 +24,17 @@
 #include <string.h>
 #include <ctype.h>
 
-#ifdef THEODORE_DASM
-#include "debugger.h"
-#endif
 #include "autostart.h"
+#include "debugger.h"
 #include "devices.h"
+#include "gdbstub.h"
 #include "keymap.h"
 #include "logger.h"
+#include "heatmap.h"
+#include "profiler.h"
 #include "sap.h"
+#include "tracer.h"
+#include "vfs.h"
 #include "motoemulator.h"
 #include "video.h"
 #include "vkeyb/vkeyb.h"
@@ -48,6 +51,8 @@ void* linearMemAlign(size_t size, size_t alignment);
 void linearFree(void* mem);
 #endif
 
+static void set_disk_control_interface(void);
+
 #define MAX_CONTROLLERS   2
 #define VIDEO_FPS         50
 #define AUDIO_SAMPLE_RATE 22050
@@ -55,12 +60,25 @@ void linearFree(void* mem);
 #define CPU_FREQUENCY     1000000
 // Pitch = length in bytes between two lines in video buffer
 #define PITCH             sizeof(pixel_fmt_t) * XBITMAP
+// Performance counters: number of frames between 2 logs (5 seconds)
+#define PERF_LOG_INTERVAL 250
 // Autorun: Number of frames to wait before simulating
 // the key stroke to start the program
 #define AUTORUN_DELAY     70
 // Virtual keyboard: Number of frames to wait when B button is pushed
 // to make the key sticky
 #define VKB_STICKY_KEY_DELAY 25
+// Floppy disk and tape: number of frames between 2 write-backs of the modifications (5 seconds)
+#define MEDIA_FLUSH_INTERVAL 250
+// Turbo during tape and floppy disk I/O: it starts after this number of emulated
+// frames with I/O (so that the short accesses of a game keep the normal speed)...
+#define TURBO_IO_START_FRAMES 10
+// ...and the emulation is back to the normal speed after this number of emulated
+// frames without I/O (0.5 second)
+#define TURBO_IO_IDLE_FRAMES  25
+// Turbo: nb of frames emulated (without display nor sound) in one retro_run
+// (the turbo only depends on the emulated frames, for netplay, run-ahead and rewind)
+#define TURBO_IO_MAX_FRAMES   20
 
 retro_log_printf_t log_cb = NULL;
 static retro_environment_t environ_cb = NULL;
@@ -85,6 +103,26 @@ static bool autostart_pending = false;
 // True if the virtual keyboard must be showed
 static bool vkb_show = false;
 
+// Performance interface of the frontend
+static struct retro_perf_callback perf_cb;
+// Time spent in each part of a frame (registered in the frontend on first use)
+// Emulation (cpu, video decoding and sound), then frontend's video and audio callbacks
+static struct retro_perf_counter perf_emulation = { "theodore_emulation", 0, 0, 0, false };
+static struct retro_perf_counter perf_video_output = { "theodore_video_output", 0, 0, 0, false };
+static struct retro_perf_counter perf_audio_output = { "theodore_audio_output", 0, 0, 0, false };
+// Periodic log of the performance counters
+static bool perf_log_enabled = false;
+static int perf_log_frames = 0;
+static PerfCounters perf_log_start;    // counters at the beginning of the period
+static retro_time_t perf_log_time[3];  // time in emulation, video and audio output (in usec)
+// Frames since the last write-back of the floppy disk and the tape
+static int media_flush_frames = 0;
+// Turbo during tape and floppy disk I/O
+static bool turbo_io_enabled = false;
+static unsigned long turbo_io_count = 0;          // last value of GetMediaIoCount()
+static int turbo_io_frames = 0;                   // emulated frames with I/O (up to TURBO_IO_START_FRAMES)
+static int turbo_io_idle = TURBO_IO_IDLE_FRAMES;  // emulated frames without I/O since the last one
+
 struct ButtonsState
 {
   bool up, down, right, left;
@@ -103,10 +141,20 @@ static const struct retro_variable prefs[] = {
     { PACKAGE_NAME"_vkb_transparency", "Virtual keyboard transparency; 0%|10%|20%|30%|40%|50%|60%|70%|80%|90%" },
     { PACKAGE_NAME"_floppy_write_protect", "Floppy write protection; enabled|disabled" },
     { PACKAGE_NAME"_tape_write_protect", "Tape write protection; enabled|disabled" },
+    { PACKAGE_NAME"_ramdisk_preload", "Copy the floppy disk to the RAM disk (drive 4); disabled|enabled" },
+    { PACKAGE_NAME"_tape_fast_load", "Tape fast loader (MO5/MO6); enabled|disabled" },
     { PACKAGE_NAME"_printer_emulation", "Dump printer data to file; disabled|enabled" },
-#ifdef THEODORE_DASM
+    { PACKAGE_NAME"_turbo_io", "Fast-forward during tape and floppy loading; enabled|disabled" },
+    { PACKAGE_NAME"_perf_log", "Log performance counters every 5 seconds; disabled|enabled" },
+    { PACKAGE_NAME"_profiler", "Profile the emulated code (written on unload); disabled|enabled" },
+    { PACKAGE_NAME"_trace", "Trace the last instructions (written on unload); disabled|1000000|4000000|16000000" },
+    { PACKAGE_NAME"_heatmap", "Memory access heatmap (written on unload); disabled|enabled" },
+#ifdef HAVE_STDIN_DEBUGGER
     { PACKAGE_NAME"_disassembler", "Interactive disassembler; disabled|enabled" },
     { PACKAGE_NAME"_break_illegal_opcode", "Break on illegal opcode; disabled|enabled" },
+#endif
+#ifdef HAVE_GDBSTUB
+    { PACKAGE_NAME"_gdb_port", "GDB remote debugging port; disabled|1234|2159|6809" },
 #endif
     { NULL, NULL }
 };
@@ -115,12 +163,20 @@ void retro_set_environment(retro_environment_t env)
 {
   // Emulator can be started without loading a game
   bool no_rom = true;
+  struct retro_vfs_interface_info vfs_info;
   env(RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME, &no_rom);
 
   // Emulator's preferences
   env(RETRO_ENVIRONMENT_SET_VARIABLES, (void *) prefs);
 
+  // File access through the frontend when possible
+  vfs_info.required_interface_version = 1;
+  vfs_info.iface = NULL;
+  vfs_init(env(RETRO_ENVIRONMENT_GET_VFS_INTERFACE, &vfs_info) ? vfs_info.iface : NULL);
+
   environ_cb = env;
+  // Before the loading of the game (for the initial disk of the set)
+  set_disk_control_interface();
 }
 
 void retro_set_video_refresh(retro_video_refresh_t video_refresh)
@@ -184,6 +240,11 @@ void retro_init(void)
     log_cb = NULL;
   }
   environ_cb(RETRO_ENVIRONMENT_SET_PERFORMANCE_LEVEL, &level);
+  if (!environ_cb(RETRO_ENVIRONMENT_GET_PERF_INTERFACE, &perf_cb))
+  {
+    memset(&perf_cb, 0, sizeof(perf_cb));
+  }
+  memset(&perfcounters, 0, sizeof(perfcounters));
 
   environ_cb(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
 
@@ -200,6 +261,11 @@ void retro_init(void)
 
 void retro_deinit(void)
 {
+  gdbstub_stop();
+  if (perf_cb.perf_log)
+  {
+    perf_cb.perf_log();
+  }
   if (video_buffer)
   {
 #ifdef _3DS
@@ -221,8 +287,9 @@ void retro_get_system_info(struct retro_system_info *info)
   memset(info, 0, sizeof(*info));
   info->library_name = PACKAGE_NAME;
   info->library_version = PACKAGE_VERSION;
-  info->valid_extensions = "fd|sap|k7|m7|m5|rom";
-  info->need_fullpath = true;
+  info->valid_extensions = "fd|sap|k7|m7|m5|rom|m3u";
+  // The content of the file is enough (the path is only used for the write-back)
+  info->need_fullpath = false;
   info->block_extract = false;
 }
 
@@ -545,23 +612,87 @@ static void check_variables(void)
   {
     SetTapeWriteProtect(strcmp(var.value, "enabled") == 0);
   }
+  var.key = PACKAGE_NAME"_ramdisk_preload";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
+  {
+    SetRamDiskPreload(strcmp(var.value, "enabled") == 0);
+  }
+  var.key = PACKAGE_NAME"_tape_fast_load";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
+  {
+    SetTapeFastLoad(strcmp(var.value, "enabled") == 0);
+  }
   var.key = PACKAGE_NAME"_printer_emulation";
   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
   {
     SetPrinterEmulationEnabled(strcmp(var.value, "enabled") == 0);
   }
+  var.key = PACKAGE_NAME"_turbo_io";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
+  {
+    turbo_io_enabled = (strcmp(var.value, "enabled") == 0);
+  }
   var.key = PACKAGE_NAME"_rom";
   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
   {
     change_model(var.value);
   }
+  var.key = PACKAGE_NAME"_perf_log";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
+  {
+    bool enabled = (strcmp(var.value, "enabled") == 0);
+    if (enabled && !perf_log_enabled)
+    {
+      // the first period starts now
+      perf_log_start = perfcounters;
+      perf_log_frames = 0;
+      memset(perf_log_time, 0, sizeof(perf_log_time));
+    }
+    perf_log_enabled = enabled;
+  }
+  var.key = PACKAGE_NAME"_profiler";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
+  {
+    if (strcmp(var.value, "enabled") == 0)
+    {
+      profiler_start();
+    }
+    else
+    {
+      profiler_stop();
+    }
+  }
+  var.key = PACKAGE_NAME"_trace";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
+  {
+    if (strcmp(var.value, "disabled") == 0)
+    {
+      tracer_stop();
+    }
+    else
+    {
+      tracer_start(atol(var.value));
+    }
+  }
+  var.key = PACKAGE_NAME"_heatmap";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
+  {
+    if (strcmp(var.value, "enabled") == 0)
+    {
+      heatmap_start();
+    }
+    else
+    {
+      heatmap_stop();
+    }
+  }
   var.key = PACKAGE_NAME"_vkb_transparency";
   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
   {
     int alpha = 255 - (255 * atoi(var.value) / 100);
     vkb_set_virtual_keyboard_transparency(alpha);
   }
-#ifdef THEODORE_DASM
+#ifdef HAVE_STDIN_DEBUGGER
   var.key = PACKAGE_NAME"_disassembler";
   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
   {
@@ -569,7 +700,7 @@ static void check_variables(void)
     {
       debugger_setMode(DEBUG_STEP);
     }
-    else
+    else if (!gdbstub_connected())
     {
       debugger_setMode(DEBUG_DISABLED);
     }
@@ -587,11 +718,74 @@ static void check_variables(void)
     }
   }
 #endif
+#ifdef HAVE_GDBSTUB
+  var.key = PACKAGE_NAME"_gdb_port";
+  if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var))
+  {
+    if (strcmp(var.value, "disabled") == 0)
+    {
+      gdbstub_stop();
+    }
+    else
+    {
+      gdbstub_start(atoi(var.value));
+    }
+  }
+#endif
 }
 
-void retro_run(void)
+// Starts the measure of a part of the frame
+static retro_time_t perf_begin(struct retro_perf_counter *counter)
+{
+  if (perf_cb.perf_register)
+  {
+    if (!counter->registered) perf_cb.perf_register(counter);
+    perf_cb.perf_start(counter);
+  }
+  return (perf_log_enabled && perf_cb.get_time_usec) ? perf_cb.get_time_usec() : 0;
+}
+
+// Ends the measure of a part of the frame
+static void perf_end(struct retro_perf_counter *counter, retro_time_t start, retro_time_t *total)
+{
+  if (perf_cb.perf_register)
+  {
+    perf_cb.perf_stop(counter);
+  }
+  if (perf_log_enabled && perf_cb.get_time_usec)
+  {
+    *total += perf_cb.get_time_usec() - start;
+  }
+}
+
+// Logs the counters per frame since the last log, then the cumulated ones
+#define PER_FRAME(counter) ((unsigned long) ((c->counter - s->counter) / n))
+static void perf_log(void)
+{
+  const PerfCounters *c = &perfcounters;
+  const PerfCounters *s = &perf_log_start;
+  unsigned long n = perf_log_frames;
+  LOG_INFO("Perf (per frame): %lu instructions, %lu cycles, %lu bank switches, "
+           "%lu segments, %lu I/O opcodes, emulation/video output/audio output %ld/%ld/%ld us "
+           "(total: %llu instructions, %llu cycles)\n",
+           PER_FRAME(instructions), PER_FRAME(cycles), PER_FRAME(bankswitches),
+           PER_FRAME(segments), PER_FRAME(iocodes),
+           (long) (perf_log_time[0] / n), (long) (perf_log_time[1] / n),
+           (long) (perf_log_time[2] / n), (unsigned long long) c->instructions,
+           (unsigned long long) c->cycles);
+#ifdef THEODORE_PERF_COUNTERS
+  LOG_INFO("Perf (per frame): reads RAM/ROM/IO %lu/%lu/%lu, writes RAM/ROM/IO %lu/%lu/%lu\n",
+           PER_FRAME(reads[MEM_RAM]), PER_FRAME(reads[MEM_ROM]), PER_FRAME(reads[MEM_IO]),
+           PER_FRAME(writes[MEM_RAM]), PER_FRAME(writes[MEM_ROM]), PER_FRAME(writes[MEM_IO]));
+#endif
+  perf_log_start = perfcounters;
+  perf_log_frames = 0;
+  memset(perf_log_time, 0, sizeof(perf_log_time));
+}
+
+// Runs the emulation for one frame (with the audio samples of the frame if audio is true)
+static void run_frame(bool audio)
 {
-  bool updated;
   int i;
   int mcycles; // nb of thousandths of cycles between 2 samples
   int icycles; // integer number of cycles between 2 samples
@@ -607,9 +801,66 @@ void retro_run(void)
     icycles = mcycles / 1000;                // integer number of cycles to run
     excess = mcycles - 1000 * icycles;       // remaining to do the next time
     excess -= 1000 * Run(icycles);           // remove thousandths in excess
-    audio_sample = GetAudioSample();
-    audio_stereo_buffer[(i << 1) + 0] = audio_stereo_buffer[(i << 1) + 1] = audio_sample;
+    if (audio)
+    {
+      audio_sample = GetAudioSample();
+      audio_stereo_buffer[(i << 1) + 0] = audio_stereo_buffer[(i << 1) + 1] = audio_sample;
+    }
+  }
+}
+
+// Counts the emulated frames with and without tape or floppy disk I/O
+// (called after each emulated frame)
+static void turbo_io_update(void)
+{
+  unsigned long count = GetMediaIoCount();
+  if (count != turbo_io_count)
+  {
+    turbo_io_count = count;
+    turbo_io_idle = 0;
+    if (turbo_io_frames < TURBO_IO_START_FRAMES) turbo_io_frames++;
+  }
+  else if ((turbo_io_idle < TURBO_IO_IDLE_FRAMES) && (++turbo_io_idle == TURBO_IO_IDLE_FRAMES))
+  {
+    // End of the I/O
+    turbo_io_frames = 0;
+  }
+}
+
+// True while the turbo must stay active
+static bool turbo_io_active(void)
+{
+  return (turbo_io_frames >= TURBO_IO_START_FRAMES) && (turbo_io_idle < TURBO_IO_IDLE_FRAMES);
+}
+
+// Turbo during tape and floppy disk I/O: runs additional frames without display
+// nor sound until the I/O stop
+static void run_turbo_frames(void)
+{
+  int n;
+  skipdisplay = true;
+  for (n = 0; (n < TURBO_IO_MAX_FRAMES) && turbo_io_active(); n++)
+  {
+    run_frame(false);
+    turbo_io_update();
+  }
+  skipdisplay = false;
+}
+
+void retro_run(void)
+{
+  bool updated;
+  retro_time_t start;
+  gdbstub_poll();
+  start = perf_begin(&perf_emulation);
+  if (turbo_io_enabled)
+  {
+    run_turbo_frames();
   }
+  // The last frame is always displayed
+  run_frame(true);
+  turbo_io_update();
+  perf_end(&perf_emulation, start, &perf_log_time[0]);
 
   update_input();
   if (vkb_show)
@@ -626,32 +877,81 @@ void retro_run(void)
     }
   }
 
+  if (++media_flush_frames >= MEDIA_FLUSH_INTERVAL)
+  {
+    media_flush_frames = 0;
+    FlushMedia();
+  }
+
   updated = false;
   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
   {
     check_variables();
   }
 
+  start = perf_begin(&perf_audio_output);
   audio_batch_cb(audio_stereo_buffer, AUDIO_SAMPLE_PER_FRAME);
+  perf_end(&perf_audio_output, start, &perf_log_time[2]);
+  start = perf_begin(&perf_video_output);
   video_cb(video_buffer, XBITMAP, YBITMAP, PITCH);
+  perf_end(&perf_video_output, start, &perf_log_time[1]);
+
+  if (perf_log_enabled && (++perf_log_frames >= PERF_LOG_INTERVAL))
+  {
+    perf_log();
+  }
 }
 
+// Disk control interface: the "disk images" are the floppy disks of the set
+// (M3U playlist, all loaded in memory) or the files of the tape.
+// Inserting a file of the tape winds it to the beginning of its header block.
+#define DISK_PATH_LENGTH 4096
+static Media disk_media = NO_MEDIA;
+static bool disk_ejected = false;
+static unsigned disk_index = 0; // index selected while the tray is open
+static bool disk_pending = false; // disk added by the frontend, not replaced yet
+static char disk_paths[FLOPPY_MAX_DISKS][DISK_PATH_LENGTH]; // files of the floppy disks
+static unsigned disk_initial_index = 0; // disk inserted at the start (set by the frontend)
+static char disk_initial_path[DISK_PATH_LENGTH];
+
+// The cycles in excess and the counters of the turbo follow the state of the emulator
+// (the I/O of the last frame are already counted), so that the frames run after
+// the loading of the state are the same as the ones run after its saving
+#define FRAME_STATE_SIZE (3 * sizeof(int))
+
 size_t retro_serialize_size(void)
 {
-  return toemulator_serialize_size();
+  return toemulator_serialize_size() + FRAME_STATE_SIZE;
 }
 
 bool retro_serialize(void *data, size_t size)
 {
-  if (size != toemulator_serialize_size()) return false;
-  toemulator_serialize(data);
+  char *buffer = (char *) data;
+  if (size != retro_serialize_size()) return false;
+  toemulator_serialize(buffer);
+  buffer += toemulator_serialize_size();
+  memcpy(buffer, &excess, sizeof(int));
+  memcpy(buffer + sizeof(int), &turbo_io_frames, sizeof(int));
+  memcpy(buffer + 2 * sizeof(int), &turbo_io_idle, sizeof(int));
   return true;
 }
 
 bool retro_unserialize(const void *data, size_t size)
 {
-  if (size != toemulator_serialize_size()) return false;
-  toemulator_unserialize(data);
+  const char *buffer = (const char *) data;
+  if (size != retro_serialize_size()) return false;
+  toemulator_unserialize(buffer);
+  buffer += toemulator_serialize_size();
+  memcpy(&excess, buffer, sizeof(int));
+  memcpy(&turbo_io_frames, buffer + sizeof(int), sizeof(int));
+  memcpy(&turbo_io_idle, buffer + 2 * sizeof(int), sizeof(int));
+  turbo_io_count = GetMediaIoCount();
+  // The disk in the drive is restored with the state
+  if (disk_media == MEDIA_FLOPPY)
+  {
+    disk_ejected = (GetFloppy() < 0);
+    if (!disk_ejected) disk_index = GetFloppy();
+  }
   return true;
 }
 
@@ -680,38 +980,153 @@ static void check_autorun(void)
   }
 }
 
+// Adds a floppy disk to the set (the content of the file is read if data is NULL).
+// The first disk starts the autostart feature.
+static bool add_floppy(const char *filename, const char *data, long size)
+{
+  char *buffer = NULL;
+  int index = GetFloppyCount();
+  bool added;
+  if (strlen(filename) >= DISK_PATH_LENGTH) return false;
+  if (data == NULL)
+  {
+    buffer = vfs_read_file(filename, &size);
+    if (buffer == NULL)
+    {
+      LOG_ERROR("Cannot read file %s.\n", filename);
+      return false;
+    }
+    data = buffer;
+  }
+  added = is_sap_file(filename) ? AddSapFromArray(filename, data, size)
+                                : AddFdFromArray(filename, data, size);
+  if (added)
+  {
+    strcpy(disk_paths[index], filename);
+    if (index == 0) autostart_init(filename, data, size);
+  }
+  else
+  {
+    LOG_ERROR("Cannot load floppy disk %s.\n", filename);
+  }
+  free(buffer);
+  return added;
+}
+
+// Loads the floppy disks of an M3U playlist (one file per line, relative to the
+// directory of the playlist, lines starting with # are comments)
+static bool load_playlist(const char *filename, const char *content, long size)
+{
+  char path[DISK_PATH_LENGTH];
+  char *line, *end;
+  int dirlength;
+  char *text = malloc(size + 1);
+  if (text == NULL) return false;
+  memcpy(text, content, size);
+  text[size] = '\0';
+  // directory of the playlist
+  for (dirlength = strlen(filename); dirlength > 0; dirlength--)
+  {
+    if ((filename[dirlength - 1] == '/') || (filename[dirlength - 1] == '\\')) break;
+  }
+  UnloadFloppy();
+  for (line = strtok(text, "\r\n"); line != NULL; line = strtok(NULL, "\r\n"))
+  {
+    while (isspace((unsigned char) *line)) line++;
+    for (end = line + strlen(line); (end > line) && isspace((unsigned char) end[-1]); end--);
+    *end = '\0';
+    if ((line[0] == '\0') || (line[0] == '#')) continue;
+    if ((line[0] == '/') || (line[0] == '\\') || (line[1] == ':'))
+    {
+      snprintf(path, sizeof(path), "%s", line);
+    }
+    else
+    {
+      snprintf(path, sizeof(path), "%.*s%s", dirlength, filename, line);
+    }
+    if (get_media_type(path) != MEDIA_FLOPPY)
+    {
+      LOG_ERROR("The playlist can only contain floppy disks (fd or sap): %s.\n", path);
+      continue;
+    }
+    if (!add_floppy(path, NULL, 0) && (GetFloppyCount() >= FLOPPY_MAX_DISKS)) break;
+  }
+  free(text);
+  if (GetFloppyCount() == 0)
+  {
+    LOG_ERROR("No floppy disk in playlist %s.\n", filename);
+    return false;
+  }
+  // disk restored by the frontend (if it is still at the same index)
+  disk_index = 0;
+  if ((disk_initial_index < (unsigned) GetFloppyCount())
+      && (strcmp(disk_paths[disk_initial_index], disk_initial_path) == 0))
+  {
+    disk_index = disk_initial_index;
+  }
+  InsertFloppy(disk_index);
+  PreloadRamDisk();
+  check_automodel(disk_paths[0]);
+  check_autorun();
+  return true;
+}
+
 // Load file with auto-detection of type based on the file extension.
-static bool load_file(const char *filename)
+// The content of the file is given by the frontend (or NULL if it must be read here).
+static bool load_file(const char *filename, const void *content, size_t content_size)
 {
-  // On some systems (e.g. Nintendo Switch) it seems that it is not possible to open a file
-  // that is already opened. As autostart_init() opens the file to read its header before
-  // closing it, it must be called BEFORE the LoadXxx() functions that open the file
-  // without (immediately) closing it.
-  autostart_init(filename);
+  char *data = NULL;
+  long size = (long) content_size;
+
+  Media currentMedia = is_m3u_file(filename) ? MEDIA_FLOPPY : get_media_type(filename);
+  if (currentMedia == NO_MEDIA)
+  {
+    LOG_ERROR("Unknown file type for file %s.\n", filename);
+    return false;
+  }
+  // The file is only read once, the devices and the autostart feature
+  // get its content (the modifications are written back by the devices)
+  if (content == NULL)
+  {
+    data = vfs_read_file(filename, &size);
+    if (data == NULL)
+    {
+      LOG_ERROR("Cannot read file %s.\n", filename);
+      return false;
+    }
+    content = data;
+  }
+  disk_media = currentMedia;
+  if (is_m3u_file(filename))
+  {
+    bool loaded = load_playlist(filename, content, size);
+    free(data);
+    return loaded;
+  }
+  autostart_init(filename, content, size);
 
-  Media currentMedia = get_media_type(filename);
   switch (currentMedia)
   {
     case MEDIA_TAPE:
-      LoadTape(filename);
+      LoadTapeFromArray(filename, content, size);
       break;
     case MEDIA_FLOPPY:
       if (is_sap_file(filename))
       {
-        LoadSap(filename);
+        LoadSapFromArray(filename, content, size);
       }
       else
       {
-        LoadFd(filename);
+        LoadFdFromArray(filename, content, size);
       }
+      if (strlen(filename) < DISK_PATH_LENGTH) strcpy(disk_paths[0], filename);
       break;
     case MEDIA_CARTRIDGE:
-      LoadMemo(filename);
-      break;
     default:
-      LOG_ERROR("Unknown file type for file %s.\n", filename);
-      return false;
+      LoadMemoFromArray(content, size);
+      break;
   }
+  free(data);
   check_automodel(filename);
   check_autorun();
   return true;
@@ -734,6 +1149,135 @@ static void keyboard_cb(bool down, unsigned keycode,
   }
 }
 
+static bool disk_set_eject_state(bool ejected)
+{
+  if (ejected == disk_ejected) return true;
+  if (disk_media == MEDIA_FLOPPY)
+  {
+    // The disks are in memory: swapping them is instantaneous
+    if (ejected && (GetFloppy() >= 0)) disk_index = GetFloppy();
+    InsertFloppy(ejected ? -1 : (int) disk_index);
+  }
+  else if (!ejected)
+  {
+    SeekTapeFile(disk_index);
+  }
+  disk_ejected = ejected;
+  return true;
+}
+
+static bool disk_get_eject_state(void)
+{
+  return disk_ejected;
+}
+
+static unsigned disk_get_image_index(void)
+{
+  int file;
+  if (disk_ejected) return disk_index;
+  file = (disk_media == MEDIA_FLOPPY) ? GetFloppy() : GetTapeFile();
+  return (file < 0) ? 0 : (unsigned) file;
+}
+
+static bool disk_set_image_index(unsigned index)
+{
+  if (!disk_ejected) return false;
+  disk_index = index;
+  return true;
+}
+
+static unsigned disk_get_num_images(void)
+{
+  if (disk_media == MEDIA_FLOPPY) return GetFloppyCount() + (disk_pending ? 1 : 0);
+  if (disk_media == MEDIA_TAPE) return GetTapeFileCount();
+  return 0;
+}
+
+// Only the floppy disk added by disk_add_image_index() can be replaced
+static bool disk_replace_image_index(unsigned index, const struct retro_game_info *info)
+{
+  if ((disk_media != MEDIA_FLOPPY) || !disk_pending || (index != (unsigned) GetFloppyCount()))
+  {
+    return false;
+  }
+  disk_pending = false;
+  if ((info == NULL) || (info->path == NULL)) return true;
+  if (get_media_type(info->path) != MEDIA_FLOPPY) return false;
+  return add_floppy(info->path, info->data, (long) info->size);
+}
+
+static bool disk_add_image_index(void)
+{
+  if ((disk_media != MEDIA_FLOPPY) || disk_pending || (GetFloppyCount() >= FLOPPY_MAX_DISKS))
+  {
+    return false;
+  }
+  disk_pending = true;
+  return true;
+}
+
+static bool disk_set_initial_image(unsigned index, const char *path)
+{
+  if ((path == NULL) || (strlen(path) >= DISK_PATH_LENGTH)) return false;
+  disk_initial_index = index;
+  strcpy(disk_initial_path, path);
+  return true;
+}
+
+static bool disk_get_image_path(unsigned index, char *path, size_t len)
+{
+  if ((disk_media != MEDIA_FLOPPY) || (index >= (unsigned) GetFloppyCount()) || (len == 0))
+  {
+    return false;
+  }
+  snprintf(path, len, "%s", disk_paths[index]);
+  return true;
+}
+
+static bool disk_get_image_label(unsigned index, char *label, size_t len)
+{
+  const char *name;
+  if (len == 0) return false;
+  if (disk_media == MEDIA_FLOPPY)
+  {
+    if (index >= (unsigned) GetFloppyCount()) return false;
+    // name of the file without its directory
+    name = disk_paths[index] + strlen(disk_paths[index]);
+    while ((name > disk_paths[index]) && (name[-1] != '/') && (name[-1] != '\\')) name--;
+  }
+  else
+  {
+    name = GetTapeFileName(index);
+  }
+  if (name == NULL) return false;
+  snprintf(label, len, "%s", name);
+  return true;
+}
+
+static void set_disk_control_interface(void)
+{
+  struct retro_disk_control_ext_callback disk_control_ext = {
+    disk_set_eject_state, disk_get_eject_state,
+    disk_get_image_index, disk_set_image_index, disk_get_num_images,
+    disk_replace_image_index, disk_add_image_index,
+    disk_set_initial_image, disk_get_image_path, disk_get_image_label
+  };
+  struct retro_disk_control_callback disk_control = {
+    disk_set_eject_state, disk_get_eject_state,
+    disk_get_image_index, disk_set_image_index, disk_get_num_images,
+    disk_replace_image_index, disk_add_image_index
+  };
+  unsigned version = 0;
+  if (environ_cb(RETRO_ENVIRONMENT_GET_DISK_CONTROL_INTERFACE_VERSION, &version) && (version >= 1))
+  {
+    environ_cb(RETRO_ENVIRONMENT_SET_DISK_CONTROL_EXT_INTERFACE, &disk_control_ext);
+  }
+  else
+  {
+    environ_cb(RETRO_ENVIRONMENT_SET_DISK_CONTROL_INTERFACE, &disk_control);
+  }
+}
+
 bool retro_load_game(const struct retro_game_info *game)
 {
   struct retro_keyboard_callback keyb_cb = { keyboard_cb };
@@ -747,13 +1291,19 @@ bool retro_load_game(const struct retro_game_info *game)
   }
 
   environ_cb(RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK, &keyb_cb);
+  disk_media = NO_MEDIA;
+  disk_ejected = false;
+  disk_pending = false;
+  turbo_io_frames = 0;
+  turbo_io_idle = TURBO_IO_IDLE_FRAMES;
+  turbo_io_count = GetMediaIoCount();
 
   check_variables();
 
   if (game && game->path)
   {
     LOG_INFO("Loading file %s.\n", game->path);
-    return load_file(game->path);
+    return load_file(game->path, game->data, game->size);
   }
   return true;
 }
@@ -770,6 +1320,9 @@ bool retro_load_game_special(
 
 void retro_unload_game(void)
 {
+  profiler_stop();
+  tracer_stop();
+  heatmap_stop();
   UnloadTape();
   UnloadFloppy();
   UnloadMemo();
@@ -20,9 +20,6 @@
 /* Thomson MO/TO emulator */
 
 #include "motoemulator.h"
-#ifdef THEODORE_DASM
-#include "debugger.h"
-#endif
 
 #include <string.h>
 #include <time.h>
@@ -30,6 +27,9 @@
 #include "6809cpu.h"
 #include "debugger.h"
 #include "devices.h"
+#include "heatmap.h"
+#include "profiler.h"
+#include "tracer.h"
 #include "video.h"
 #include "rom/rom_to8.inc"
 #include "rom/rom_to8d.inc"
@@ -63,17 +63,25 @@ typedef struct
   int *disk_drive_monitor_patch; // MO5/MO6: Patch to apply to the disk drive monitor
   bool is_mo;                    // If it is a MO or TO system
   bool is_mo6;                   // If it is a MO6 or a PC128
+  int basic_size;                // Size of the "BASIC" part of the ROM
+  int monitor_size;              // Size of the "monitor" part of the ROM
+  const TapeBlockRoutine *tape_block; // Block read routine of the monitor (tape fast loader)
+  int ramdisk_tracks;            // Size of the RAM disk (drive 4) in tracks (0 if none)
 } SystemRom;
 
-static SystemRom ROM_TO8 = { to8_basic_rom, to8_basic_patch, to8_monitor_rom, to8_monitor_patch, NULL, NULL, false, false };
-static SystemRom ROM_TO8D = { to8_basic_rom, to8_basic_patch, to8d_monitor_rom, to8d_monitor_patch, NULL, NULL, false, false };
-static SystemRom ROM_TO9 = { to9_basic_rom, to9_basic_patch, to9_monitor_rom, to9_monitor_patch, NULL, NULL, false, false };
-static SystemRom ROM_TO9P = { to9p_basic_rom, to9p_basic_patch, to9p_monitor_rom, to9p_monitor_patch, NULL, NULL, false, false };
-static SystemRom ROM_MO5 = { mo5_v2_basic_rom, mo5_v2_basic_patch, mo5_v2_monitor_rom, mo5_v2_monitor_patch, cd90_640_rom, cd90_640_patch, true, false };
-static SystemRom ROM_MO6 = { mo6_v3_basic128_rom, mo6_v3_basic128_patch, mo6_v3_basic1_rom, mo6_v3_basic1_patch, cd90_640_rom, cd90_640_patch, true, true };
-static SystemRom ROM_PC128 = { pc128_basic128_rom, pc128_basic128_patch, pc128_basic1_rom, pc128_basic1_patch, cd90_640_rom, cd90_640_patch, true, true };
-static SystemRom ROM_TO770 = { NULL, NULL, to770_monitor_rom, to770_monitor_patch, NULL, NULL, false, false };
-static SystemRom ROM_TO7 = { NULL, NULL, to7_monitor_rom, to7_monitor_patch, NULL, NULL, false, false };
+// Block read routines of the MO monitors (the TO monitors only read the tape byte by byte)
+static const TapeBlockRoutine TAPE_BLOCK_MO5 = { 0xf10d, 0xf167, 2 };
+static const TapeBlockRoutine TAPE_BLOCK_MO6 = { 0xf3c6, 0xf461, 0 };
+
+static SystemRom ROM_TO8 = { to8_basic_rom, to8_basic_patch, to8_monitor_rom, to8_monitor_patch, NULL, NULL, false, false, sizeof(to8_basic_rom), sizeof(to8_monitor_rom), NULL, 80 };
+static SystemRom ROM_TO8D = { to8_basic_rom, to8_basic_patch, to8d_monitor_rom, to8d_monitor_patch, NULL, NULL, false, false, sizeof(to8_basic_rom), sizeof(to8d_monitor_rom), NULL, 80 };
+static SystemRom ROM_TO9 = { to9_basic_rom, to9_basic_patch, to9_monitor_rom, to9_monitor_patch, NULL, NULL, false, false, sizeof(to9_basic_rom), sizeof(to9_monitor_rom), NULL, 40 };
+static SystemRom ROM_TO9P = { to9p_basic_rom, to9p_basic_patch, to9p_monitor_rom, to9p_monitor_patch, NULL, NULL, false, false, sizeof(to9p_basic_rom), sizeof(to9p_monitor_rom), NULL, 80 };
+static SystemRom ROM_MO5 = { mo5_v2_basic_rom, mo5_v2_basic_patch, mo5_v2_monitor_rom, mo5_v2_monitor_patch, cd90_640_rom, cd90_640_patch, true, false, sizeof(mo5_v2_basic_rom), sizeof(mo5_v2_monitor_rom), &TAPE_BLOCK_MO5, 0 };
+static SystemRom ROM_MO6 = { mo6_v3_basic128_rom, mo6_v3_basic128_patch, mo6_v3_basic1_rom, mo6_v3_basic1_patch, cd90_640_rom, cd90_640_patch, true, true, sizeof(mo6_v3_basic128_rom), sizeof(mo6_v3_basic1_rom), &TAPE_BLOCK_MO6, 40 };
+static SystemRom ROM_PC128 = { pc128_basic128_rom, pc128_basic128_patch, pc128_basic1_rom, pc128_basic1_patch, cd90_640_rom, cd90_640_patch, true, true, sizeof(pc128_basic128_rom), sizeof(pc128_basic1_rom), &TAPE_BLOCK_MO6, 40 };
+static SystemRom ROM_TO770 = { NULL, NULL, to770_monitor_rom, to770_monitor_patch, NULL, NULL, false, false, 0, sizeof(to770_monitor_rom), NULL, 0 };
+static SystemRom ROM_TO7 = { NULL, NULL, to7_monitor_rom, to7_monitor_patch, NULL, NULL, false, false, 0, sizeof(to7_monitor_rom), NULL, 0 };
 
 static ThomsonModel currentModel = TO8;
 static SystemRom *rom = &ROM_TO8;
@@ -105,6 +113,7 @@ int videolinecycle;         //compteur ligne (0-63)
 int videolinenumber;        //numero de ligne video affichee (0-311)
 static int vblnumber;       //compteur du nombre de vbl avant affichage
 static int displayflag;     //indicateur pour l'affichage
+bool skipdisplay = false;   //pas d'affichage pendant l'avance rapide
 int bordercolor;            //couleur de la bordure de l'écran
 //divers
 static int sound;                  //niveau du haut-parleur
@@ -113,6 +122,12 @@ static int timer6846;       //compteur du timer 6846
 static int latch6846;       //registre latch du timer 6846
 static int keyb_irqcount;   //nombre de cycles avant la fin de l'irq clavier
 static int timer_irqcount;  //nombre de cycles avant la fin de l'irq timer
+//statistiques
+PerfCounters perfcounters;  //compteurs de performances
+static MemoryType memtype[16]; //type de memoire de chaque page de 4 Ko
+static char *mappage[16];      //memoire de chaque page de 4 Ko (NULL si decodage specifique)
+static unsigned short ioports = 0xe7c0; //adresse des ports d'entree/sortie (a7c0 ou e7c0)
+static bool mempagesdirty = true; //memtype, mappage et ioports a recalculer
 //reserved data in serialization for future use
 static int reserved1 = 0;
 static int reserved2 = 0;
@@ -127,9 +142,88 @@ static void MputMo(unsigned short a, char c);
 static char MgetTo7(unsigned short a);
 static void MputTo7(unsigned short a, char c);
 
+//handlers de la memoire du modele (Mgetc/Mputc sans instrumentation)
+static char (*mgetc)(unsigned short a) = MgetTo;
+static void (*mputc)(unsigned short a, char c) = MputTo;
+static bool instrumented = false; //boucle d'execution instrumentee
+static bool memwatched = false;   //acces memoire surveilles (debugger, heatmap)
+
 void (*selectVideoRam)(void);
 void (*selectRomBank)(void);
 
+// Mise a jour du signal IRQ du 6846 /////////////////////////////////////////
+// Called only when an interrupt source of the 6846 changes (end of the timer
+// or keyboard irq, write to the status register), not after each instruction.
+static void Update6846Irq(void)
+{
+  //fin du signal irq timer
+  if(timer_irqcount <= 0) port[0x00] &= 0xfe;
+  //fin du signal irq clavier
+  if(keyb_irqcount <= 0) port[0x00] &= 0xfd;
+  //clear signal irq si aucune irq active
+  if((port[0x00] & 0x07) == 0) {port[0x00] &= 0x7f; dc6809.interrupts &= ~INT_IRQ;}
+}
+
+// Comptage des acces memoire par type (RAM, ROM, entrees/sorties)
+// Only with the PERF_COUNTERS build option: one more increment for each access
+// makes the whole emulation measurably slower.
+#ifdef THEODORE_PERF_COUNTERS
+#define MEMTYPE(a) (updateMemoryPages(), (((a) & 0xffc0) == ioports) ? MEM_IO : memtype[(a) >> 12])
+#define COUNT_READ(a) perfcounters.reads[MEMTYPE(a)]++
+#define COUNT_WRITE(a) perfcounters.writes[MEMTYPE(a)]++
+#else
+#define COUNT_READ(a)
+#define COUNT_WRITE(a)
+#endif
+
+// Mise a jour de la memoire de chaque page de 4 Ko //////////////////////////
+// Mirrors the decoding of MgetTo/MgetTo7/MgetMo: physical location of each
+// page for the heatmap and type of memory for the performance counters.
+// Les commutations de banques ne font que marquer les pages a recalculer :
+// le calcul est fait a la premiere utilisation (debugger, heatmap ou
+// compteurs PERF_COUNTERS), jamais dans la boucle d'emulation normale.
+static void updateMemoryPages(void)
+{
+  int i;
+  if (!mempagesdirty) return;
+  mempagesdirty = false;
+  if (mgetc == MgetMo)
+  {
+    for(i = 0x0; i <= 0x9; i++) memtype[i] = MEM_RAM;
+    for(i = 0xa; i <= 0xf; i++) memtype[i] = MEM_ROM;
+    ioports = 0xa7c0;
+    mappage[0x0] = mappage[0x1] = ramvideo;
+    for(i = 0x2; i <= 0x5; i++) mappage[i] = ramuser;
+    for(i = 0x6; i <= 0x9; i++) mappage[i] = rom->is_mo6 ? rambank : ramuser;
+    mappage[0xa] = NULL; //controleur de disquette et ports
+    for(i = 0xb; i <= 0xe; i++) mappage[i] = rombank;
+  }
+  else
+  {
+    //la banque ram peut recouvrir l'espace rom (TO8/TO9+)
+    for(i = 0x0; i <= 0x3; i++)
+      memtype[i] = ((mgetc == MgetTo) && (port[0x26] & 0x20)) ? MEM_RAM : MEM_ROM;
+    for(i = 0x4; i <= 0xd; i++) memtype[i] = MEM_RAM;
+    memtype[0xe] = memtype[0xf] = MEM_ROM;
+    ioports = 0xe7c0;
+    if ((mgetc == MgetTo) && (port[0x26] & 0x20))
+    {
+      //les deux segments de 8 Ko de la banque ram sont inverses
+      mappage[0x0] = mappage[0x1] = rombank + 0x2000;
+      mappage[0x2] = mappage[0x3] = rombank - 0x2000;
+    }
+    else
+    {
+      for(i = 0x0; i <= 0x3; i++) mappage[i] = rombank;
+    }
+    mappage[0x4] = mappage[0x5] = ramvideo;
+    for(i = 0x6; i <= 0x9; i++) mappage[i] = ramuser;
+    for(i = 0xa; i <= 0xd; i++) mappage[i] = (currentModel == TO7) ? ramuser : rambank;
+    mappage[0xe] = romsys; //sauf les ports
+  }
+  mappage[0xf] = romsys;
+}
+
 //Table de conversion scancode TO9 --> code ASCII
 const int to9key[0xa0] =
 {
@@ -243,6 +337,7 @@ void SetThomsonModel(ThomsonModel model)
     }
     currentModel = model;
     SetModeTO(!rom->is_mo);
+    SetTapeBlockRoutine(rom->tape_block);
     Hardreset();
   }
 }
@@ -270,6 +365,7 @@ void keyboard(int scancode, bool down)
     //si toutes les touches sont relachees
     port[0x08] = 0x00; //bit 0 de E7C8 = 0 (toutes les touches relachees)
     keyb_irqcount = 0;
+    Update6846Irq();
     return;
   }
   //touche enfoncee
@@ -292,7 +388,7 @@ void keyboard(int scancode, bool down)
     port[0x08] |= 0x01; //bit 0 de E7C8 = 1 (touche enfoncee)
     port[0x00] |= 0x82; //bit CP1 = interruption clavier
     keyb_irqcount = 500000; //positionne le signal d'irq pour 500 ms maximum
-    dc6809_irq = 1;
+    dc6809.interrupts |= INT_IRQ;
   }
   else // TO9 / TO9+
   {
@@ -321,6 +417,7 @@ static void selectVideoRamTo(void)
   nsystbank = (currentModel != TO9) ? (port[0x03] & 0x10) >> 4 : 0;
   // The "monitor" software is mapped in memory starting at address 0xe000
   romsys = rom->monitor - 0xe000 + (nsystbank << 13);
+  mempagesdirty = true;
 }
 
 static void selectVideoRamTo7(void)
@@ -340,6 +437,7 @@ static void selectVideoRamTo7(void)
     // TO7/70 (Pastel + BGR)
     bordercolor = ((port[0x03] >> 4) & 0x07) | ((~port[0x03] & 0x04) << 1);
   }
+  mempagesdirty = true;
 }
 
 static void selectVideoRamMo5(void)
@@ -350,6 +448,7 @@ static void selectVideoRamMo5(void)
   // The "monitor" software is mapped in memory starting at address 0xf000
   romsys = rom->monitor - 0xf000;
   bordercolor = (port[0] >> 1) & 0x0f;
+  mempagesdirty = true;
 }
 
 static void selectVideoRamMo6(void)
@@ -359,11 +458,13 @@ static void selectVideoRamMo6(void)
   ramvideo = ram + (nvideopage << 13);
   // The "monitor" software is mapped in memory starting at address 0xf000
   romsys = rom->monitor + ((port[0] & 0x20) << 9) + 0x3000 - 0xf000;
+  mempagesdirty = true;
 }
 
 static void selectRamBankTo(void)
 {
   int nrambank; // RAM page (TO8 mode) or bank (TO7/TO9 mode) number
+  perfcounters.bankswitches++;
 
   // TO8 mode (5 lower bits of e7e5 = RAM page number)
   // (bit D4 of gate array mode page's "system 1" register at e7e7 = 0
@@ -390,18 +491,22 @@ static void selectRamBankTo(void)
     // RAM bank n = RAM page n+2 at physical address 0x4000*(n+2) and logical address 0xa000
     rambank = ram - (0xa000 - 0x8000) + (nrambank << 14);
   }
+  mempagesdirty = true;
 }
 
 static void selectRamBankMo6(void)
 {
   int nrampage; // RAM page number
+  perfcounters.bankswitches++;
   nrampage = port[0x25] & 0x1f;
   rambank = ram - 0x6000 + (nrampage << 14);
+  mempagesdirty = true;
 }
 
 static void selectRomBankTo(void)
 {
   int nrombank;        //numero banque rom (00-07)
+  perfcounters.bankswitches++;
   if (currentModel != TO9)
   {
     //romsys = rom + 0x2000 + ((cnt[0x7c3] & 0x10) << 9);
@@ -449,15 +554,19 @@ static void selectRomBankTo(void)
       default: break;
     }
   }
+  mempagesdirty = true;
 }
 
 static void selectRomBankTo7(void)
 {
+  perfcounters.bankswitches++;
   rombank = car + ((carflags & 3) << 14);
+  mempagesdirty = true;
 }
 
 static void selectRomBankMo5(void)
 {
+  perfcounters.bankswitches++;
   if ((carflags & 4) == 0)
   {
     rombank = rom->basic - 0xc000;
@@ -467,10 +576,12 @@ static void selectRomBankMo5(void)
     rombank = car - 0xb000 + ((carflags & 0x03) << 14);
     if ((cartype == 2) && (carflags & 0x10)) rombank += 0x10000;
   }
+  mempagesdirty = true;
 }
 
 static void selectRomBankMo6(void)
 {
+  perfcounters.bankswitches++;
   if ((carflags & 4) == 0)
   {
     if (port[0x1d] & 0x10)
@@ -491,6 +602,7 @@ static void selectRomBankMo6(void)
     rombank = car - 0xb000 + ((carflags & 0x03) << 14);
     if ((cartype == 2) && (carflags & 0x10)) rombank += 0x10000;
   }
+  mempagesdirty = true;
 }
 
 static void SwitchMemo5Bank(int a)
@@ -604,16 +716,16 @@ void Initprog(void)
     ramuser = ram + 0x2000;
     SetVideoMode(VIDEO_320_16_MO5);
     pagevideo = ram;
-    Mputc = MputMo;
-    Mgetc = MgetMo;
+    mputc = MputMo;
+    mgetc = MgetMo;
     selectVideoRam = selectVideoRamMo5;
     selectRomBank = selectRomBankMo5;
   }
   else if (rom->is_mo6)
   {
     ramuser = ram + 0x2000;
-    Mputc = MputMo;
-    Mgetc = MgetMo;
+    mputc = MputMo;
+    mgetc = MgetMo;
     selectVideoRam = selectVideoRamMo6;
     selectRomBank = selectRomBankMo6;
     port[0x25] = 0x02; // RAM bank 0 selected
@@ -622,8 +734,8 @@ void Initprog(void)
   else if ((currentModel == TO7) || (currentModel == TO7_70))
   {
     ramuser = ram - 0x2000;
-    Mputc = MputTo7;
-    Mgetc = MgetTo7;
+    mputc = MputTo7;
+    mgetc = MgetTo7;
     selectVideoRam = selectVideoRamTo7;
     selectRomBank = selectRomBankTo7;
     videopage_bordercolor(port[0x1d]);
@@ -636,8 +748,8 @@ void Initprog(void)
   else
   {
     ramuser = ram - 0x2000;
-    Mputc = MputTo;
-    Mgetc = MgetTo;
+    mputc = MputTo;
+    mgetc = MgetTo;
     selectVideoRam = selectVideoRamTo;
     selectRomBank = selectRomBankTo;
     videopage_bordercolor(port[0x1d]);
@@ -645,6 +757,7 @@ void Initprog(void)
     selectRamBankTo();
   }
 
+  UpdateInstrumentation();
   selectVideoRam();
   selectRomBank();
   Reset6809();
@@ -702,6 +815,8 @@ void Hardreset(void)
     memset(car, 0, CARTRIDGE_MEM_SIZE);
   }
   RewindTape();
+  // The RAM disk is lost like the RAM
+  SetRamDiskSize(rom->ramdisk_tracks);
 
   // Patch the ROM
   if ((rom->basic != NULL) && (rom->basic_patch != NULL))
@@ -740,22 +855,100 @@ static void Timercontrol(void)
   if(port[0x05] & 0x01) timer6846 = latch6846 << 3;
 }
 
+// Instrumentation (debugger, profiler, trace, heatmap) /////////////////////
+// Selects the instrumented variants of the run loop and of the memory
+// handlers only when they are needed, the normal path being left untouched.
+static char MgetInstrumented(unsigned short a)
+{
+  if (debug_mem_breakpoints) debug_mem_read(a);
+  if (heatmapping) heatmap_read(a);
+  return mgetc(a);
+}
+
+static void MputInstrumented(unsigned short a, char c)
+{
+  if (debug_mem_breakpoints) debug_mem_write(a);
+  if (heatmapping) heatmap_write(a);
+  mputc(a, c);
+}
+
+bool IsIoAddress(unsigned short a)
+{
+  updateMemoryPages();
+  return ((a & 0xffc0) == ioports) || ((mgetc == MgetMo) && ((a & 0xfffc) == 0xbffc));
+}
+
+char Mpeek(unsigned short a)
+{
+  return IsIoAddress(a) ? 0 : mgetc(a);
+}
+
+// Debut et taille d'un espace de memoire physique du modele courant
+static char *memorySpace(MemorySpace space, int *size)
+{
+  switch(space)
+  {
+    case SPACE_RAM: *size = RAM_SIZE; return ram;
+    case SPACE_CARTRIDGE: *size = CARTRIDGE_MEM_SIZE; return car;
+    case SPACE_BASIC_ROM: *size = rom->basic_size; return rom->basic;
+    case SPACE_MONITOR_ROM: *size = rom->monitor_size; return rom->monitor;
+    default:
+      *size = (rom->disk_drive_monitor != NULL) ? (int) sizeof(cd90_640_rom) : 0;
+      return rom->disk_drive_monitor;
+  }
+}
+
+int MemorySpaceSize(MemorySpace space)
+{
+  int size;
+  memorySpace(space, &size);
+  return size;
+}
+
+bool PhysicalAddress(unsigned short a, MemorySpace *space, int *offset)
+{
+  const char *p, *base;
+  int i, size;
+  if (IsIoAddress(a)) return false;
+  if ((mgetc == MgetTo7) && ((a & 0xf800) == 0xe000)) return false; //pas de rom
+  if (mappage[a >> 12] != NULL) p = mappage[a >> 12] + a;
+  else if (a < 0xa7c0) p = rom->disk_drive_monitor + (a & 0x7ff); //MO : a000-a7bf
+  else return false;
+  for (i = 0; i < SPACE_COUNT; i++)
+  {
+    base = memorySpace(i, &size);
+    if ((size > 0) && (p >= base) && (p < base + size))
+    {
+      *space = i;
+      *offset = p - base;
+      return true;
+    }
+  }
+  return false;
+}
+
+void UpdateInstrumentation(void)
+{
+  instrumented = debugger_enabled() || profiling || tracing || heatmapping;
+  memwatched = debug_mem_breakpoints || heatmapping;
+  Mgetc = memwatched ? MgetInstrumented : mgetc;
+  Mputc = memwatched ? MputInstrumented : mputc;
+}
+
 // Execution n cycles processeur 6809 ////////////////////////////////////////
-int Run(int ncyclesmax)
+static int RunCycles(int ncyclesmax)
 {
-  int ncycles, opcycles;
-  ncycles = 0;
+  int ncycles, opcycles, ninstructions;
+  ncycles = ninstructions = 0;
   while(ncycles < ncyclesmax)
   {
-#ifdef THEODORE_DASM
-    debug(dc6809_pc & 0xFFFF);
-#endif
     //execution d'une instruction
     opcycles = Run6809();
-    if(opcycles < 0) {RunIoOpcode(-opcycles); opcycles = 64;}
+    ninstructions++;
+    if(opcycles < 0) {RunIoOpcode(-opcycles); opcycles = 64; perfcounters.iocodes++;}
     ncycles += opcycles;
     videolinecycle += opcycles;
-    if(displayflag) Displaysegment();
+    if(displayflag) {Displaysegment(); perfcounters.segments++;}
     // Attente d'une fin de ligne
     if(videolinecycle >= 64)
     {
@@ -772,18 +965,22 @@ int Run(int ncyclesmax)
         if(++vblnumber >= VBL_NUMBER_MAX) vblnumber = 0;
         if (rom->is_mo) Irq();
       }
-      displayflag = ((vblnumber == 0) && (videolinenumber > 47) && (videolinenumber < 264));
+      displayflag = (!skipdisplay && (vblnumber == 0) && (videolinenumber > 47) && (videolinenumber < 264));
     }
     if (!rom->is_mo)
     {
-      //decompte du temps de presence du signal irq timer
-      if(timer_irqcount > 0) timer_irqcount -= opcycles;
-      if(timer_irqcount <= 0) port[0x00] &= 0xfe;
-      //decompte du temps de presence du signal irq clavier
-      if(keyb_irqcount > 0) keyb_irqcount -= opcycles;
-      if(keyb_irqcount <= 0) port[0x00] &= 0xfd;
-      //clear signal irq si aucune irq active
-      if((port[0x00] & 0x07) == 0) {port[0x00] &= 0x7f; dc6809_irq = 0;}
+      //decompte du temps de presence des signaux irq timer et clavier
+      //(le signal irq n'est mis a jour qu'a l'expiration d'un compteur)
+      if(timer_irqcount > 0)
+      {
+        timer_irqcount -= opcycles;
+        if(timer_irqcount <= 0) Update6846Irq();
+      }
+      if(keyb_irqcount > 0)
+      {
+        keyb_irqcount -= opcycles;
+        if(keyb_irqcount <= 0) Update6846Irq();
+      }
       //countdown du timer 6846
       if((port[0x05] & 0x01) == 0) //timer enabled
       {timer6846 -= (port[0x05] & 0x04) ? opcycles : opcycles << 3;} //countdown
@@ -793,19 +990,44 @@ int Run(int ncyclesmax)
         timer_irqcount = 100;
         timer6846 = latch6846 << 3; //reset counter
         port[0x00] |= 0x81; //flag interruption timer et interruption composite
-        dc6809_irq = 1; //positionner le signal IRQ pour le processeur
+        dc6809.interrupts |= INT_IRQ; //positionner le signal IRQ pour le processeur
       }
     }
   }
+  perfcounters.instructions += ninstructions;
+  perfcounters.cycles += ncycles;
   return(ncycles - ncyclesmax); //retour du nombre de cycles en trop (extracycles)
 }
 
+// Execution instrumentee : la boucle normale est appelee pour chaque instruction
+// (RunCycles(1) execute exactement une instruction)
+static int RunInstrumented(int ncyclesmax)
+{
+  int ncycles, opcycles;
+  ncycles = 0;
+  while(ncycles < ncyclesmax)
+  {
+    //emulation arretee par le debugger distant : le reste de la periode est perdu
+    if(!debug(dc6809.pc.uw & 0xFFFF)) return 0;
+    if(tracing) tracer_record(perfcounters.cycles);
+    if(heatmapping) heatmap_execute(dc6809.pc.uw);
+    if(profiling) profiler_before();
+    opcycles = RunCycles(1) + 1;
+    if(profiling) profiler_after(opcycles);
+    ncycles += opcycles;
+  }
+  return(ncycles - ncyclesmax);
+}
+
+int Run(int ncyclesmax)
+{
+  return instrumented ? RunInstrumented(ncyclesmax) : RunCycles(ncyclesmax);
+}
+
 // TO8/TO9 memory write /////////////////////////////////////////////////////
 static void MputTo(unsigned short a, char c)
 {
-#ifdef THEODORE_DASM
-  debug_mem_write(a);
-#endif
+  COUNT_WRITE(a);
   switch(a >> 12)
   {
     case 0x0: case 0x1:
@@ -831,9 +1053,10 @@ static void MputTo(unsigned short a, char c)
     case 0xe:
       switch(a)
       {
-        case 0xe7c0: port[0x00] = c; return;
+        case 0xe7c0: port[0x00] = c; Update6846Irq(); return;
         case 0xe7c1: port[0x01] = c; mute = c & 8; return;
-        case 0xe7c3: port[0x03] = (c & 0x3d); if((c & 0x20) == 0) keyb_irqcount = 0;
+        case 0xe7c3: port[0x03] = (c & 0x3d);
+        if((c & 0x20) == 0) {keyb_irqcount = 0; Update6846Irq();}
         selectVideoRam(); selectRomBank(); return;
         case 0xe7c5: port[0x05] = c; Timercontrol(); return; //controle timer
         case 0xe7c6: latch6846 = (latch6846 & 0xff) | ((c & 0xff) << 8); return;
@@ -904,11 +1127,11 @@ static char floppy_controller_emu(unsigned short a)
                               //            bit 1 = information "ready" du lecteur
     case 0xe7d3:
       // Detect sequence LDB $03,X / CMPB #$??
-      if (((Mgetc(dc6809_pc) & 0xff) == 0xc1) && ((Mgetc(dc6809_pc-1) & 0xff) == 0x03)
-          && ((Mgetc(dc6809_pc-2) & 0xff) == 0xe6)) return Mgetc(dc6809_pc+1);
+      if (((Mgetc(dc6809.pc.uw) & 0xff) == 0xc1) && ((Mgetc(dc6809.pc.uw-1) & 0xff) == 0x03)
+          && ((Mgetc(dc6809.pc.uw-2) & 0xff) == 0xe6)) return Mgetc(dc6809.pc.uw+1);
       // Detect sequence LDA $03,X / CMPA #$??
-      else if (((Mgetc(dc6809_pc) & 0xff) == 0x81) && ((Mgetc(dc6809_pc-1) & 0xff) == 0x03)
-          && ((Mgetc(dc6809_pc-2) & 0xff) == 0xa6)) return Mgetc(dc6809_pc+1);
+      else if (((Mgetc(dc6809.pc.uw) & 0xff) == 0x81) && ((Mgetc(dc6809.pc.uw-1) & 0xff) == 0x03)
+          && ((Mgetc(dc6809.pc.uw-2) & 0xff) == 0xa6)) return Mgetc(dc6809.pc.uw+1);
       else return port[a & 0x3f];
     default: return port[a & 0x3f];
   }
@@ -917,9 +1140,7 @@ static char floppy_controller_emu(unsigned short a)
 // TO8/TO9 memory read //////////////////////////////////////////////////////
 static char MgetTo(unsigned short a)
 {
-#ifdef THEODORE_DASM
-  debug_mem_read(a);
-#endif
+  COUNT_READ(a);
   switch(a >> 12)
   {
     //subtilite : quand la rom est recouverte par la ram, les 2 segments de 8 Ko sont inverses
@@ -969,9 +1190,7 @@ static char MgetTo(unsigned short a)
 // TO7-TO7/70 memory write /////////////////////////////////////////////////////
 static void MputTo7(unsigned short a, char c)
 {
-#ifdef THEODORE_DASM
-  debug_mem_write(a);
-#endif
+  COUNT_WRITE(a);
   switch(a >> 12)
   {
     // 0000->3fff: Cartouche enfichable MEMO7
@@ -1000,7 +1219,7 @@ static void MputTo7(unsigned short a, char c)
         // e7c5: Timer Control Register
         // e7c6: Timer MSB
         // e7c7: Timer LSB
-        case 0xe7c0: port[0x00] = c; return;
+        case 0xe7c0: port[0x00] = c; Update6846Irq(); return;
         case 0xe7c1: port[0x01] = c; mute = c & 8; return;
         case 0xe7c3: port[0x03] = (c & 0x7d);
         selectVideoRam(); selectRomBank(); return;
@@ -1082,9 +1301,7 @@ static char readTo7KeybPortA()
 // TO7-TO7/70 memory read //////////////////////////////////////////////////////
 static char MgetTo7(unsigned short a)
 {
-#ifdef THEODORE_DASM
-  debug_mem_read(a);
-#endif
+  COUNT_READ(a);
   switch(a >> 12)
   {
     // 0000->3fff: Cartouche enfichable MEMO7
@@ -1152,9 +1369,7 @@ static char MgetTo7(unsigned short a)
 // MO5/MO6 memory write ///////////////////////////////////////////////////////////
 static void MputMo(unsigned short a, char c)
 {
-#ifdef THEODORE_DASM
-  debug_mem_write(a);
-#endif
+  COUNT_WRITE(a);
   switch(a >> 12)
   {
     case 0x0: case 0x1: ramvideo[a] = c; return;
@@ -1219,9 +1434,7 @@ static char mo6keybPB7()
 // MO5/MO6 memory read ////////////////////////////////////////////////////////////
 static char MgetMo(unsigned short a)
 {
-#ifdef THEODORE_DASM
-  debug_mem_read(a);
-#endif
+  COUNT_READ(a);
   switch(a >> 12)
   {
     case 0x0: case 0x1: return ramvideo[a];
@@ -1415,6 +1628,7 @@ void toemulator_unserialize(const void *data)
   offset += sizeof(keyb_irqcount);
   memcpy(&timer_irqcount, buffer+offset, sizeof(timer_irqcount));
 
+  if (!rom->is_mo) Update6846Irq();
   if (currentModel != MO5)
   {
     videopage_bordercolor(port[0x1d]);
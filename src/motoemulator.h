@@ -60,6 +60,30 @@ extern int videolinenumber;
 extern int bordercolor;
 //pointeur page video affichee
 extern char *pagevideo;
+//true pour emuler sans mettre a jour l'ecran (avance rapide)
+extern bool skipdisplay;
+
+//statistiques
+typedef enum { MEM_RAM, MEM_ROM, MEM_IO } MemoryType;
+//compteurs de performances (cumules, remis a zero par l'utilisateur)
+//reads/writes : seulement avec l'option PERF_COUNTERS
+//64 bits sur toutes les plateformes (unsigned long est sur 32 bits sous Windows,
+//les cycles deborderaient apres 71 minutes d'emulation)
+typedef struct
+{
+  uint64_t instructions;  //instructions executees
+  uint64_t cycles;        //cycles emules (horodatage de la trace d'execution)
+  uint64_t reads[3];      //lectures memoire (Mgetc) par MemoryType
+  uint64_t writes[3];     //ecritures memoire (Mputc) par MemoryType
+  uint64_t bankswitches;  //commutations de banques RAM/ROM
+  uint64_t segments;      //segments d'ecran (Displaysegment)
+  uint64_t iocodes;       //codes operatoires d'entree/sortie (RunIoOpcode)
+} PerfCounters;
+extern PerfCounters perfcounters;
+
+//espaces de memoire physique
+typedef enum { SPACE_RAM, SPACE_CARTRIDGE, SPACE_BASIC_ROM, SPACE_MONITOR_ROM,
+               SPACE_DISK_ROM, SPACE_COUNT } MemorySpace;
 
 typedef enum { JOY0_UP, JOY0_DOWN, JOY0_LEFT, JOY0_RIGHT,
                JOY1_UP, JOY1_DOWN, JOY1_LEFT, JOY1_RIGHT,
@@ -77,6 +101,20 @@ void keyboard(int scancode, bool down);
 void Initprog(void);
 // Execution of n CPU cycles
 int Run(int ncyclesmax);
+// True for the addresses whose read has side effects
+// (I/O ports, bank switch of the MEMO5 cartridges)
+bool IsIoAddress(unsigned short a);
+// Reads a byte for the tools (debugger, profiler, trace, GDB server) without side effects:
+// no memory breakpoint nor heatmap count, and 0 for the I/O ports
+char Mpeek(unsigned short a);
+// Size of a physical memory space of the current model (0 if it has none)
+int MemorySpaceSize(MemorySpace space);
+// Physical location of the byte read at the address a with the current mapping
+// of the banks (false for the I/O ports and the unmapped addresses)
+bool PhysicalAddress(unsigned short a, MemorySpace *space, int *offset);
+// Selects the normal or the instrumented (debugger, profiler, trace, heatmap) run loop
+// and memory handlers (to be called when one of them is enabled or disabled)
+void UpdateInstrumentation(void);
 // Hardreset of the computer
 void Hardreset(void);
 // Sets the Thomson model emulated (default=TO8)
@@ -0,0 +1,426 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Profiler of the emulated 6809 code.
+ * The cycles of each instruction are counted by address, and in a call tree
+ * built by following the calls (JSR, BSR, LBSR, SWI, interrupts) and the
+ * returns (detected when S goes above the stack frame of the call, which
+ * covers RTS, RTI, PULS PC and stack resets).
+ * The functions are identified by their logical entry address: code in
+ * switched banks at the same address is merged. */
+
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "6809cpu.h"
+#include "6809disasm.h"
+#include "logger.h"
+#include "motoemulator.h"
+
+// Maximum size of an instruction
+#define CODE_SIZE 5
+// Maximum number of nodes of the call tree and depth of the call stack
+#define MAX_NODES 65536
+#define MAX_DEPTH 256
+
+// Interrupt vectors
+#define VECTOR_FIRQ 0xfff6
+#define VECTOR_IRQ  0xfff8
+#define VECTOR_NMI  0xfffc
+
+// Node of the call tree (a function in a given call stack)
+typedef struct
+{
+  unsigned short function;  // entry address
+  unsigned short callsite;  // address of the calling instruction
+  int parent;
+  int child;                // first child
+  int sibling;              // next child of the parent
+  unsigned long calls;
+  unsigned long long cycles;       // self cost
+  unsigned long long instructions;
+  unsigned long long inclusive;    // cost including the called functions
+  unsigned long long inclusiveinstructions;
+} Node;
+
+// Frame of the call stack
+typedef struct
+{
+  int node;
+  unsigned short s;         // value of S after the call (the frame ends above)
+} Frame;
+
+// Call of a function by another one (edge of the callgrind call graph)
+typedef struct
+{
+  unsigned short caller;
+  unsigned short callsite;
+  unsigned short callee;
+  unsigned long calls;
+  unsigned long long inclusive;
+  unsigned long long inclusiveinstructions;
+} Call;
+
+bool profiling = false;
+
+static Node *nodes = NULL;
+static int nnodes;
+static Frame stack[MAX_DEPTH];
+static int depth;
+// Cycles, number of executions, function and listing line of each address
+static unsigned long long *addrcycles = NULL;
+static unsigned long *addrcount = NULL;
+static unsigned short *addrfunction = NULL;
+static int *addrline = NULL;
+// Code of each address when it was executed for the first time
+// (the listing is not affected by the later bank switches)
+static unsigned char (*addrcode)[CODE_SIZE] = NULL;
+static unsigned short listingaddress;
+// Executed addresses, sorted by function then by address
+static unsigned short *addresses = NULL;
+static int naddresses;
+// State before the current instruction
+static unsigned short lastpc, lasts;
+static int lastopcode;
+// State expected after the last instruction (to detect the interrupts
+// triggered outside of Run6809(), e.g. the MO vertical blank)
+static unsigned short nextpc, nexts;
+
+static int new_node(int parent, unsigned short function, unsigned short callsite)
+{
+  Node *n;
+  int i;
+  for (i = nodes[parent].child; i >= 0; i = nodes[i].sibling)
+  {
+    if ((nodes[i].function == function) && (nodes[i].callsite == callsite)) return i;
+  }
+  if (nnodes == MAX_NODES) return parent;
+  n = &nodes[nnodes];
+  memset(n, 0, sizeof(Node));
+  n->function = function;
+  n->callsite = callsite;
+  n->parent = parent;
+  n->child = -1;
+  n->sibling = nodes[parent].child;
+  nodes[parent].child = nnodes;
+  return nnodes++;
+}
+
+static void push(unsigned short function, unsigned short callsite, unsigned short s)
+{
+  int node;
+  if (depth == MAX_DEPTH) return;
+  node = new_node(stack[depth - 1].node, function, callsite);
+  nodes[node].calls++;
+  stack[depth].node = node;
+  stack[depth].s = s;
+  depth++;
+}
+
+// Returns from the functions whose stack frame has been freed
+static void pop(unsigned short s)
+{
+  while ((depth > 1) && (s > stack[depth - 1].s)) depth--;
+}
+
+// Reads an interrupt vector (without side effects)
+static unsigned short vector(unsigned short a)
+{
+  return ((Mpeek(a) & 0xff) << 8) | (Mpeek(a + 1) & 0xff);
+}
+
+static bool is_interrupt_entry(unsigned short pc, unsigned short s, unsigned short olds)
+{
+  if (s == (unsigned short) (olds - 12))
+    return (pc == vector(VECTOR_IRQ)) || (pc == vector(VECTOR_NMI));
+  if (s == (unsigned short) (olds - 3))
+    return pc == vector(VECTOR_FIRQ);
+  return false;
+}
+
+static void free_memory(void)
+{
+  free(nodes); free(addrcycles); free(addrcount); free(addrfunction); free(addrline); free(addrcode);
+  nodes = NULL; addrcycles = NULL; addrcount = NULL; addrfunction = NULL; addrline = NULL; addrcode = NULL;
+}
+
+void profiler_start(void)
+{
+  if (profiling) return;
+  nodes = malloc(MAX_NODES * sizeof(Node));
+  addrcycles = calloc(0x10000, sizeof(unsigned long long));
+  addrcount = calloc(0x10000, sizeof(unsigned long));
+  addrfunction = calloc(0x10000, sizeof(unsigned short));
+  addrline = calloc(0x10000, sizeof(int));
+  addrcode = calloc(0x10000, CODE_SIZE);
+  if (!nodes || !addrcycles || !addrcount || !addrfunction || !addrline || !addrcode)
+  {
+    LOG_ERROR("Not enough memory for the profiler.\n");
+    free_memory();
+    return;
+  }
+  // The root of the call tree is the code running when the profiler starts
+  memset(&nodes[0], 0, sizeof(Node));
+  nodes[0].function = nodes[0].callsite = dc6809.pc.uw;
+  nodes[0].parent = nodes[0].child = nodes[0].sibling = -1;
+  nodes[0].calls = 1;
+  nnodes = 1;
+  stack[0].node = 0;
+  stack[0].s = 0xffff;
+  depth = 1;
+  nextpc = dc6809.pc.uw;
+  nexts = dc6809.s.uw;
+  profiling = true;
+  UpdateInstrumentation();
+}
+
+void profiler_before(void)
+{
+  lastpc = dc6809.pc.uw;
+  lasts = dc6809.s.uw;
+  // Interrupt taken between 2 instructions
+  if (((lastpc != nextpc) || (lasts != nexts)) && is_interrupt_entry(lastpc, lasts, nexts))
+  {
+    push(lastpc, nextpc, lasts);
+  }
+  if (addrcount[lastpc] == 0)
+  {
+    int i;
+    for (i = 0; i < CODE_SIZE; i++)
+    {
+      unsigned short a = lastpc + i;
+      addrcode[lastpc][i] = Mpeek(a);
+    }
+  }
+  lastopcode = Mpeek(lastpc) & 0xff;
+  if ((lastopcode == 0x10) || (lastopcode == 0x11))
+  {
+    lastopcode = (lastopcode == 0x10 ? 0x100 : 0x200) | (Mpeek(lastpc + 1) & 0xff);
+  }
+}
+
+void profiler_after(int cycles)
+{
+  unsigned short pc = dc6809.pc.uw;
+  unsigned short s = dc6809.s.uw;
+  bool swi = (lastopcode == 0x3f) || (lastopcode == 0x13f) || (lastopcode == 0x23f);
+
+  nextpc = pc;
+  nexts = s;
+  // Interrupt taken by Run6809() instead of the instruction
+  if (!swi && is_interrupt_entry(pc, s, lasts))
+  {
+    push(pc, lastpc, s);
+    nodes[stack[depth - 1].node].cycles += cycles;
+    return;
+  }
+  // Cost of the instruction (in the function running it)
+  nodes[stack[depth - 1].node].cycles += cycles;
+  nodes[stack[depth - 1].node].instructions++;
+  addrcycles[lastpc] += cycles;
+  addrcount[lastpc]++;
+  addrfunction[lastpc] = nodes[stack[depth - 1].node].function;
+  // Returns, then calls
+  pop(s);
+  switch (lastopcode)
+  {
+    case 0x17: case 0x8d: case 0x9d: case 0xad: case 0xbd: // LBSR, BSR, JSR
+      if (s == (unsigned short) (lasts - 2)) push(pc, lastpc, s);
+      break;
+    case 0x3f: case 0x13f: case 0x23f: // SWI, SWI2, SWI3
+      if (s == (unsigned short) (lasts - 12)) push(pc, lastpc, s);
+      break;
+    default:
+      break;
+  }
+}
+
+// Inclusive cycles of the call tree (the children have a greater index)
+static void compute_inclusive(void)
+{
+  int i;
+  for (i = 0; i < nnodes; i++)
+  {
+    nodes[i].inclusive = nodes[i].cycles;
+    nodes[i].inclusiveinstructions = nodes[i].instructions;
+  }
+  for (i = nnodes - 1; i > 0; i--)
+  {
+    nodes[nodes[i].parent].inclusive += nodes[i].inclusive;
+    nodes[nodes[i].parent].inclusiveinstructions += nodes[i].inclusiveinstructions;
+  }
+}
+
+static int compare_addresses(const void *p1, const void *p2)
+{
+  unsigned short a1 = *(const unsigned short *) p1, a2 = *(const unsigned short *) p2;
+  if (addrfunction[a1] != addrfunction[a2]) return addrfunction[a1] - addrfunction[a2];
+  return a1 - a2;
+}
+
+static bool sort_addresses(void)
+{
+  int a;
+  addresses = malloc(0x10000 * sizeof(unsigned short));
+  if (addresses == NULL) return false;
+  for (a = 0, naddresses = 0; a < 0x10000; a++)
+    if (addrcount[a] > 0) addresses[naddresses++] = a;
+  qsort(addresses, naddresses, sizeof(unsigned short), compare_addresses);
+  return true;
+}
+
+// Folded stacks: "f1;f2;f3 cycles" for each call stack
+static void write_folded(const char *filename)
+{
+  int i, n, path[MAX_DEPTH + 1];
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) return;
+  for (i = 0; i < nnodes; i++)
+  {
+    if (nodes[i].cycles == 0) continue;
+    for (n = i, path[0] = 0; (n >= 0) && (path[0] < MAX_DEPTH); n = nodes[n].parent) path[++path[0]] = n;
+    for (n = path[0]; n > 0; n--)
+      fprintf(fp, "$%04X%s", nodes[path[n]].function, (n > 1) ? ";" : "");
+    fprintf(fp, " %llu\n", nodes[i].cycles);
+  }
+  fclose(fp);
+}
+
+// Disassembly of the executed instructions, grouped by function.
+// Stores the line of each instruction in addrline.
+static char listing_getc(unsigned short a)
+{
+  unsigned short offset = a - listingaddress;
+  return (offset < CODE_SIZE) ? addrcode[listingaddress][offset] : 0;
+}
+
+static void write_listing(const char *filename)
+{
+  char (*savedgetc)(unsigned short) = Mgetc;
+  char string[64];
+  int i, a, line = 1;
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) return;
+  Mgetc = listing_getc;
+  fprintf(fp, "; theodore profile: address, code, instruction, cpu cycles, executions, total cycles\n");
+  for (i = 0; i < naddresses; i++)
+  {
+    a = addresses[i];
+    if ((i == 0) || (addrfunction[a] != addrfunction[addresses[i - 1]]))
+    {
+      fprintf(fp, "\n; function $%04X\n", addrfunction[a]);
+      line += 2;
+    }
+    listingaddress = a;
+    dasm6809(a, string);
+    fprintf(fp, "%-40s %10lu %12llu\n", string, addrcount[a], addrcycles[a]);
+    addrline[a] = ++line;
+  }
+  Mgetc = savedgetc;
+  fclose(fp);
+}
+
+static int compare_calls(const void *p1, const void *p2)
+{
+  const Call *c1 = p1, *c2 = p2;
+  if (c1->caller != c2->caller) return c1->caller - c2->caller;
+  if (c1->callsite != c2->callsite) return c1->callsite - c2->callsite;
+  return c1->callee - c2->callee;
+}
+
+// Callgrind format (positions = lines of the listing)
+static void write_callgrind(const char *filename)
+{
+  Call *calls;
+  unsigned long long total = 0, count = 0;
+  int a, i, n;
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) return;
+
+  for (a = 0; a < 0x10000; a++)
+  {
+    total += addrcycles[a];
+    count += addrcount[a];
+  }
+  fprintf(fp, "version: 1\ncreator: theodore\npositions: line\nevents: Cycles Instructions\n");
+  fprintf(fp, "summary: %llu %llu\n\nfl=%s\n", total, count, PROFILER_LISTING_FILE);
+
+  // Self cost of the functions
+  for (i = 0; i < naddresses; i++)
+  {
+    a = addresses[i];
+    if ((i == 0) || (addrfunction[a] != addrfunction[addresses[i - 1]]))
+      fprintf(fp, "\nfn=$%04X\n", addrfunction[a]);
+    fprintf(fp, "%d %llu %lu\n", addrline[a], addrcycles[a], addrcount[a]);
+  }
+
+  // Calls (the call tree is merged by caller, call site and callee)
+  calls = malloc(nnodes * sizeof(Call));
+  if (calls != NULL)
+  {
+    for (i = 1, n = 0; i < nnodes; i++, n++)
+    {
+      calls[n].caller = nodes[nodes[i].parent].function;
+      calls[n].callsite = nodes[i].callsite;
+      calls[n].callee = nodes[i].function;
+      calls[n].calls = nodes[i].calls;
+      calls[n].inclusive = nodes[i].inclusive;
+      calls[n].inclusiveinstructions = nodes[i].inclusiveinstructions;
+    }
+    qsort(calls, n, sizeof(Call), compare_calls);
+    for (i = 0; i < n; i++)
+    {
+      if ((i + 1 < n) && (compare_calls(&calls[i], &calls[i + 1]) == 0))
+      {
+        calls[i + 1].calls += calls[i].calls;
+        calls[i + 1].inclusive += calls[i].inclusive;
+        calls[i + 1].inclusiveinstructions += calls[i].inclusiveinstructions;
+        continue;
+      }
+      if ((i == 0) || (calls[i].caller != calls[i - 1].caller))
+        fprintf(fp, "\nfn=$%04X\n", calls[i].caller);
+      fprintf(fp, "cfn=$%04X\ncalls=%lu %d\n%d %llu %llu\n", calls[i].callee, calls[i].calls,
+              addrline[calls[i].callee], addrline[calls[i].callsite], calls[i].inclusive,
+              calls[i].inclusiveinstructions);
+    }
+    free(calls);
+  }
+  fclose(fp);
+}
+
+void profiler_stop(void)
+{
+  if (!profiling) return;
+  profiling = false;
+  compute_inclusive();
+  write_folded(PROFILER_FOLDED_FILE);
+  if (sort_addresses())
+  {
+    write_listing(PROFILER_LISTING_FILE);
+    write_callgrind(PROFILER_CALLGRIND_FILE);
+    free(addresses);
+    addresses = NULL;
+  }
+  LOG_INFO("Profile written to %s, %s and %s (%d call stacks).\n", PROFILER_CALLGRIND_FILE,
+           PROFILER_FOLDED_FILE, PROFILER_LISTING_FILE, nnodes);
+  free_memory();
+  UpdateInstrumentation();
+}
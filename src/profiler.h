@@ -0,0 +1,47 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Profiler of the emulated 6809 code */
+
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include "boolean.h"
+
+// Files written when the profiler is stopped
+#define PROFILER_CALLGRIND_FILE "callgrind.out.theodore"
+#define PROFILER_FOLDED_FILE    "theodore-profile.folded"
+#define PROFILER_LISTING_FILE   "theodore-profile.asm"
+
+// True while the profiler is running (Run() then uses its instrumented loop)
+extern bool profiling;
+
+/* Starts the profiler (the call stack starts at the current instruction). */
+void profiler_start(void);
+/* Stops the profiler and writes the profile:
+ * - callgrind format (for KCachegrind), with the listing as source file,
+ * - folded stacks (for flamegraph.pl),
+ * - disassembly listing of the executed code with the cycles of each instruction. */
+void profiler_stop(void);
+
+/* Must be called before and after each instruction (or interrupt)
+ * with the number of cycles returned by Run6809(). */
+void profiler_before(void);
+void profiler_after(int cycles);
+
+#endif /* __PROFILER_H */
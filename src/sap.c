@@ -19,7 +19,7 @@
 /* Management of the SAP file format */
 
 #include "sap.h"
-#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define SAP_HEADER_SIZE        66
@@ -32,53 +32,52 @@
 #define SAP_SECTOR_SIZE(f)     (SECTOR_SIZE(f) + SAP_SECTOR_OVERHEAD)
 #define SAP_SECTOR_MAX_SIZE    (256 + SAP_SECTOR_OVERHEAD)
 #define SAP_SECTORS_PER_TRACK  16
+#define SAP_MAX_TRACKS         80
 
 #define SAP_HEADER             "SYSTEME D'ARCHIVAGE PUKALL S.A.P."
 
-/* table de calcul du CRC */
-static const short int puktable[] = {
-   0x0000, 0x1081, 0x2102, 0x3183,
-   0x4204, 0x5285, 0x6306, 0x7387,
-   0x8408, 0x9489, 0xa50a, 0xb58b,
-   0xc60c, 0xd68d, 0xe70e, 0xf78f
+/* table de calcul du CRC, octet par octet
+ * (crctable[i] = CRC de l'octet i a partir d'un CRC nul, soit les deux
+ * etapes de 4 bits de la table d'origine de 16 valeurs) */
+static const short int crctable[] = {
+  0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
+  0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
+  0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
+  0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
+  0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
+  0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
+  0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
+  0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
+  0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
+  0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
+  0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
+  0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
+  0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
+  0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
+  0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
+  0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
+  0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
+  0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
+  0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
+  0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
+  0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
+  0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
+  0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
+  0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
+  0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
+  0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
+  0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
+  0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
+  0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
+  0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
+  0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
+  0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
 };
 
-SapFile sap_open(const char *filename)
-{
-  FILE *file;
-  char header[SAP_HEADER_SIZE];
-  SapFile sapFile = { 0, NULL };
-
-  file = fopen(filename, "rb+");
-  if (file == NULL)
-  {
-    return sapFile;
-  }
-  if (fread(header, SAP_HEADER_SIZE, 1, file) != 1)
-  {
-    fclose(file);
-    return sapFile;
-  }
-  if (((header[0] != 1) && (header[0] != 2)) || strncmp(header + 1, SAP_HEADER, sizeof(SAP_HEADER) - 1) != 0)
-  {
-    fclose(file);
-    return sapFile;
-  }
-  sapFile.format = header[0];
-  sapFile.handle = file;
-  return sapFile;
-}
-
 // Update CRC with new data c.
 static short int update_crc(char c, short int crc)
 {
-    short int index;
-    index = (crc ^ c) & 0xf;
-    crc = ((crc >> 4) & 0xfff) ^ puktable[index];
-    c >>= 4;
-    index = (crc ^ c) & 0xf;
-    crc = ((crc >> 4) & 0xfff) ^ puktable[index];
-    return crc;
+    return ((crc >> 8) & 0xff) ^ crctable[(crc ^ c) & 0xff];
 }
 
 // Computes CRC of a sector.
@@ -94,91 +93,179 @@ static short int compute_crc(char *sap_sector, int sector_size)
     return crc;
 }
 
-DiskErrCode sap_readSector(const SapFile *file, int track, int sector, char *data)
+static void free_sectors(SapFile *file)
+{
+  free(file->data);
+  free(file->headers);
+  free(file->status);
+  free(file->dirty);
+  file->data = file->headers = NULL;
+  file->status = NULL;
+  file->dirty = NULL;
+  file->nsectors = 0;
+}
+
+// Decodes the sectors of the file: header, data and result of the read.
+static bool read_sectors(SapFile *file, const char *content, long size)
 {
-  int i;
+  int i, j;
   short int expected_crc, actual_crc;
   char sap_sector[SAP_SECTOR_MAX_SIZE];
   int sector_size = SECTOR_SIZE(file->format);
   int sap_sector_size = SAP_SECTOR_SIZE(file->format);
-  int offset = SAP_HEADER_SIZE + (track * SAP_SECTORS_PER_TRACK + sector - 1) * sap_sector_size;
+  int n = SAP_MAX_TRACKS * SAP_SECTORS_PER_TRACK;
 
-  if (fseek(file->handle, offset, SEEK_SET))
+  file->data = malloc(n * sector_size);
+  file->headers = malloc(n * SAP_SECTOR_DATA_OFFSET);
+  file->status = malloc(n);
+  file->dirty = calloc(n, sizeof(bool));
+  if (!file->data || !file->headers || !file->status || !file->dirty)
   {
-    return DISK_IO_ERROR;
+    free_sectors(file);
+    return false;
   }
-  if (fread(sap_sector, sap_sector_size, 1, file->handle) != 1)
+  for (i = 0; (i < n) && (SAP_HEADER_SIZE + (i + 1) * sap_sector_size <= size); i++)
   {
-    return DISK_IO_ERROR;
+    memcpy(sap_sector, content + SAP_HEADER_SIZE + i * sap_sector_size, sap_sector_size);
+    for (j = 0; j < sector_size; j++)
+    {
+      sap_sector[SAP_SECTOR_DATA_OFFSET + j] ^= SAP_MAGIC_NUM;
+    }
+    memcpy(file->headers + i * SAP_SECTOR_DATA_OFFSET, sap_sector, SAP_SECTOR_DATA_OFFSET);
+    memcpy(file->data + i * sector_size, sap_sector + SAP_SECTOR_DATA_OFFSET, sector_size);
+    // Format = 4
+    if (sap_sector[0] == 4)
+    {
+      file->status[i] = DISK_DATA_ERROR;
+      continue;
+    }
+    // Check sector CRC
+    expected_crc = compute_crc(sap_sector, sap_sector_size);
+    actual_crc = (sap_sector[sap_sector_size-2] << 8) + (sap_sector[sap_sector_size-1] & 0xFF);
+    file->status[i] = (actual_crc != expected_crc) ? DISK_IO_ERROR : DISK_NO_ERROR;
   }
-  for (i = 0; i < sector_size; i++)
+  file->nsectors = i;
+  file->modified = false;
+  return true;
+}
+
+SapFile sap_open(const char *filename, const char *content, long size)
+{
+  SapFile sapFile;
+
+  memset(&sapFile, 0, sizeof(sapFile));
+  if (size < SAP_HEADER_SIZE)
   {
-    sap_sector[SAP_SECTOR_DATA_OFFSET + i] ^= SAP_MAGIC_NUM;
-    data[i] = sap_sector[SAP_SECTOR_DATA_OFFSET + i];
+    return sapFile;
   }
-  // Format = 4
-  if (sap_sector[0] == 4)
+  if (((content[0] != 1) && (content[0] != 2)) || strncmp(content + 1, SAP_HEADER, sizeof(SAP_HEADER) - 1) != 0)
   {
-    return DISK_DATA_ERROR;
+    return sapFile;
   }
-  // Check sector CRC
-  expected_crc = compute_crc(sap_sector, sap_sector_size);
-  actual_crc = (sap_sector[sap_sector_size-2] << 8) + (sap_sector[sap_sector_size-1] & 0xFF);
-  if (actual_crc != expected_crc)
+  sapFile.format = content[0];
+  if (read_sectors(&sapFile, content, size) && (filename != NULL) && (filename[0] != '\0'))
   {
-    return DISK_IO_ERROR;
+    sapFile.handle = vfs_open(filename);
   }
-  return DISK_NO_ERROR;
+  return sapFile;
 }
 
-DiskErrCode sap_writeSector(const SapFile *file, int track, int sector, char *data)
+DiskErrCode sap_readSector(const SapFile *file, int track, int sector, char *data)
 {
-  int i;
-  short int crc;
-  char sap_sector[SAP_SECTOR_MAX_SIZE];
   int sector_size = SECTOR_SIZE(file->format);
-  int sap_sector_size = SAP_SECTOR_SIZE(file->format);
-  int offset = SAP_HEADER_SIZE + (track * SAP_SECTORS_PER_TRACK + sector - 1) * sap_sector_size;
+  int index = track * SAP_SECTORS_PER_TRACK + sector - 1;
 
-  if (fseek(file->handle, offset, SEEK_SET))
+  if (index >= file->nsectors)
   {
     return DISK_IO_ERROR;
   }
-  // Re-use the same sector's header data then the current one
-  if (fread(sap_sector, SAP_SECTOR_DATA_OFFSET, 1, file->handle) != 1)
-  {
-    return DISK_IO_ERROR;
-  }
-  // Rewind to the beginning of the sector
-  if (fseek(file->handle, offset, SEEK_SET))
+  memcpy(data, file->data + index * sector_size, sector_size);
+  return file->status[index];
+}
+
+DiskErrCode sap_writeSector(SapFile *file, int track, int sector, char *data)
+{
+  int sector_size = SECTOR_SIZE(file->format);
+  int index = track * SAP_SECTORS_PER_TRACK + sector - 1;
+
+  if (index >= file->nsectors)
   {
     return DISK_IO_ERROR;
   }
   // Sector protected
-  if (sap_sector[1] != 0)
+  if (file->headers[index * SAP_SECTOR_DATA_OFFSET + 1] != 0)
   {
     return DISK_SECTOR_PROTECTED_ERROR;
   }
-  memcpy(sap_sector + SAP_SECTOR_DATA_OFFSET, data, sector_size);
-  // Compute sector CRC
-  crc = compute_crc(sap_sector, sap_sector_size);
-  sap_sector[sap_sector_size-2] = crc >> 8;
-  sap_sector[sap_sector_size-1] = crc & 0xFF;
-  // Encrypt sector data
-  for (i = 0; i < sector_size; i++)
+  memcpy(file->data + index * sector_size, data, sector_size);
+  // The CRC is computed again when the sector is written back
+  if (file->status[index] == DISK_IO_ERROR)
+  {
+    file->status[index] = DISK_NO_ERROR;
+  }
+  file->dirty[index] = file->modified = true;
+  return DISK_NO_ERROR;
+}
+
+bool sap_flush(SapFile *file)
+{
+  int i, j, n;
+  short int crc;
+  char *sap_sector, *buffer;
+  int sector_size = SECTOR_SIZE(file->format);
+  int sap_sector_size = SAP_SECTOR_SIZE(file->format);
+
+  if (!file->modified || (file->handle == NULL))
+  {
+    return true;
+  }
+  buffer = malloc(file->nsectors * sap_sector_size);
+  if (buffer == NULL)
   {
-    sap_sector[SAP_SECTOR_DATA_OFFSET + i] ^= SAP_MAGIC_NUM;
+    return false;
   }
-  if (fwrite(sap_sector, sap_sector_size, 1, file->handle) != 1)
+  file->modified = false;
+  for (i = 0; i < file->nsectors; i += n)
   {
-    return DISK_IO_ERROR;
+    // Consecutive modified sectors are encoded then written at once
+    for (n = 0; (i + n < file->nsectors) && file->dirty[i + n]; n++)
+    {
+      file->dirty[i + n] = false;
+      sap_sector = buffer + n * sap_sector_size;
+      memcpy(sap_sector, file->headers + (i + n) * SAP_SECTOR_DATA_OFFSET, SAP_SECTOR_DATA_OFFSET);
+      memcpy(sap_sector + SAP_SECTOR_DATA_OFFSET, file->data + (i + n) * sector_size, sector_size);
+      // Compute sector CRC
+      crc = compute_crc(sap_sector, sap_sector_size);
+      sap_sector[sap_sector_size-2] = crc >> 8;
+      sap_sector[sap_sector_size-1] = crc & 0xFF;
+      // Encrypt sector data
+      for (j = 0; j < sector_size; j++)
+      {
+        sap_sector[SAP_SECTOR_DATA_OFFSET + j] ^= SAP_MAGIC_NUM;
+      }
+    }
+    if (n == 0)
+    {
+      n = 1;
+    }
+    else if (!vfs_write(file->handle, SAP_HEADER_SIZE + i * sap_sector_size, buffer, n * sap_sector_size))
+    {
+      free(buffer);
+      return false;
+    }
   }
-  return DISK_NO_ERROR;
+  free(buffer);
+  return vfs_flush(file->handle);
 }
 
 bool sap_close(SapFile *file)
 {
-  bool result = (fclose(file->handle) == 0);
+  bool result = sap_flush(file);
+  if (file->handle != NULL)
+  {
+    vfs_close(file->handle);
+  }
+  free_sectors(file);
   file->format = 0;
   file->handle = NULL;
   return result;
@@ -21,13 +21,20 @@
 #ifndef __SAP_H
 #define __SAP_H
 
-#include <stdio.h>
 #include "boolean.h"
+#include "vfs.h"
 
 typedef struct
 {
   unsigned char format;
-  FILE *handle;
+  VfsFile *handle;           // file for the write-back (NULL if read-only)
+  // Content of the file, decoded when it is opened
+  int nsectors;              // number of sectors of the file
+  char *data;                // plain data of the sectors (NULL if no file is opened)
+  char *headers;             // header of each sector (format, protection, track, sector)
+  unsigned char *status;     // error code of the read of each sector (DiskErrCode)
+  bool *dirty;               // sectors modified since the last write-back
+  bool modified;
 } SapFile;
 
 // Error code that must be written in the DK.STA register ($604E).
@@ -48,16 +55,21 @@ typedef enum
   DISK_WRITE_PROTECTION_ERROR = 71
 } DiskErrCode;
 
-// Opens a SAP file.
-// SapFile.handle is NULL in case of error.
-SapFile sap_open(const char *filename);
+// Decodes all the sectors of a SAP file from its content (the CRCs are checked once here).
+// The modified sectors are written back to the file 'filename' when it is writable.
+// SapFile.data is NULL in case of error.
+SapFile sap_open(const char *filename, const char *content, long size);
 // Reads a given sector from the SAP file and stores its content in the 'data' buffer.
 // Returns the error code to put in DK.STA register if not 0.
 DiskErrCode sap_readSector(const SapFile *file, int track, int sector, char *data);
 // Writes a given sector into the SAP file from the content of the 'data' buffer.
+// The sector is only encoded and written to the file by sap_flush().
 // Returns the error code to put in DK.STA register if not 0.
-DiskErrCode sap_writeSector(const SapFile *file, int track, int sector, char *data);
-// Closes the SAP file.
+DiskErrCode sap_writeSector(SapFile *file, int track, int sector, char *data);
+// Writes the modified sectors back to the SAP file (if it is writable).
+// Returns true for success, false for failure.
+bool sap_flush(SapFile *file);
+// Writes the modified sectors back and closes the SAP file.
 // Returns true for success, false for failure.
 bool sap_close(SapFile *file);
 
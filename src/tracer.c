@@ -0,0 +1,114 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Binary execution trace of the emulated 6809 code.
+ * The state of the CPU before each instruction is stored in a ring buffer,
+ * so that the last instructions executed can be written to a file and
+ * disassembled offline (theodore-trace) without slowing down the emulation. */
+
+#include "tracer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "6809cpu.h"
+#include "logger.h"
+#include "motoemulator.h"
+
+bool tracing = false;
+
+static unsigned char *buffer = NULL;
+static long capacity;  // number of records of the buffer
+static long count;     // number of records stored
+static long next;      // index of the next record
+
+static void put_word(unsigned char *p, unsigned short w)
+{
+  p[0] = w & 0xff;
+  p[1] = w >> 8;
+}
+
+void tracer_start(long length)
+{
+  if (tracing || (length <= 0)) return;
+  buffer = malloc(length * TRACER_RECORD_SIZE);
+  if (buffer == NULL)
+  {
+    LOG_ERROR("Not enough memory for the trace of %ld instructions.\n", length);
+    return;
+  }
+  capacity = length;
+  count = next = 0;
+  tracing = true;
+  UpdateInstrumentation();
+}
+
+void tracer_record(unsigned long long cycles)
+{
+  unsigned char *p = buffer + next * TRACER_RECORD_SIZE;
+  unsigned short pc = dc6809.pc.uw;
+  int i;
+  for (i = 0; i < 8; i++) p[i] = (cycles >> (8 * i)) & 0xff;
+  put_word(p + 8, pc);
+  put_word(p + 10, dc6809.x.uw);
+  put_word(p + 12, dc6809.y.uw);
+  put_word(p + 14, dc6809.u.uw);
+  put_word(p + 16, dc6809.s.uw);
+  p[18] = dc6809.d.b.h;
+  p[19] = dc6809.d.b.l;
+  p[20] = dc6809.da.b.h;
+  p[21] = dc6809.cc;
+  for (i = 0; i < TRACER_CODE_SIZE; i++)
+  {
+    p[22 + i] = Mpeek(pc + i);
+  }
+  p[27] = dc6809.interrupts;
+  if (++next == capacity) next = 0;
+  if (count < capacity) count++;
+}
+
+void tracer_stop(void)
+{
+  FILE *fp;
+  unsigned char header[TRACER_HEADER_SIZE];
+  long first;
+  if (!tracing) return;
+  tracing = false;
+  UpdateInstrumentation();
+  fp = fopen(TRACER_FILE, "wb");
+  if (fp == NULL)
+  {
+    LOG_ERROR("Cannot write the trace to %s.\n", TRACER_FILE);
+  }
+  else
+  {
+    memcpy(header, TRACER_MAGIC, 8);
+    put_word(header + 8, count & 0xffff);
+    put_word(header + 10, (count >> 16) & 0xffff);
+    fwrite(header, 1, TRACER_HEADER_SIZE, fp);
+    // Oldest record first
+    first = (count < capacity) ? 0 : next;
+    fwrite(buffer + first * TRACER_RECORD_SIZE, TRACER_RECORD_SIZE, count - first, fp);
+    fwrite(buffer, TRACER_RECORD_SIZE, first, fp);
+    fclose(fp);
+    LOG_INFO("Trace of the last %ld instructions written to %s.\n", count, TRACER_FILE);
+  }
+  free(buffer);
+  buffer = NULL;
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Binary execution trace of the emulated 6809 code */
+
+#ifndef __TRACER_H
+#define __TRACER_H
+
+#include "boolean.h"
+
+// File written when the trace is stopped (decoded by theodore-trace)
+#define TRACER_FILE "theodore-trace.bin"
+
+/* Format of the file (all the values are little-endian):
+ * - header: "THEOTRC1", then the number of records (4 bytes),
+ * - records of TRACER_RECORD_SIZE bytes, from the oldest to the newest
+ *   instruction, each one describing the state before the instruction:
+ *   0: cycle stamp (8 bytes), 8: PC, 10: X, 12: Y, 14: U, 16: S (2 bytes each),
+ *   18: A, 19: B, 20: DP, 21: CC, 22: the 5 bytes at PC (0 for the I/O ports),
+ *   27: pending interrupts (INT_xxx bits of dc6809.interrupts). */
+#define TRACER_MAGIC       "THEOTRC1"
+#define TRACER_HEADER_SIZE 12
+#define TRACER_RECORD_SIZE 28
+#define TRACER_CODE_SIZE   5
+
+// True while the trace is running (Run() then uses its instrumented loop)
+extern bool tracing;
+
+/* Starts the trace, keeping the last "length" instructions in memory. */
+void tracer_start(long length);
+/* Stops the trace and writes the recorded instructions to TRACER_FILE. */
+void tracer_stop(void);
+/* Must be called before each instruction with the cycle stamp of the instruction. */
+void tracer_record(unsigned long long cycles);
+
+#endif /* __TRACER_H */
@@ -0,0 +1,123 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Access to the media files, through the VFS interface of the frontend
+ * when it provides one (the C library is used otherwise).
+ * The media are read at once when they are loaded: only the write-back of
+ * the modified data keeps a file open. */
+
+#include "vfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libretro-common/include/libretro.h"
+
+struct VfsFile
+{
+  FILE *fp;                              // C library
+  struct retro_vfs_file_handle *handle;  // VFS of the frontend
+};
+
+static struct retro_vfs_interface *vfs = NULL;
+
+void vfs_init(struct retro_vfs_interface *iface)
+{
+  vfs = iface;
+}
+
+char *vfs_read_file(const char *path, long *size)
+{
+  char *data = NULL;
+  if (vfs != NULL)
+  {
+    struct retro_vfs_file_handle *handle = vfs->open(path, RETRO_VFS_FILE_ACCESS_READ,
+                                                     RETRO_VFS_FILE_ACCESS_HINT_NONE);
+    if (handle == NULL) return NULL;
+    *size = (long) vfs->size(handle);
+    // The buffer is never empty so that NULL is only returned for errors
+    if ((*size >= 0) && ((data = malloc(*size + 1)) != NULL)
+        && (vfs->read(handle, data, *size) != *size))
+    {
+      free(data);
+      data = NULL;
+    }
+    vfs->close(handle);
+  }
+  else
+  {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) return NULL;
+    if (!fseek(fp, 0, SEEK_END) && ((*size = ftell(fp)) >= 0) && !fseek(fp, 0, SEEK_SET)
+        && ((data = malloc(*size + 1)) != NULL)
+        && (fread(data, 1, *size, fp) != (size_t) *size))
+    {
+      free(data);
+      data = NULL;
+    }
+    fclose(fp);
+  }
+  return data;
+}
+
+VfsFile *vfs_open(const char *path)
+{
+  VfsFile *file = calloc(1, sizeof(VfsFile));
+  if (file == NULL) return NULL;
+  if (vfs != NULL)
+  {
+    file->handle = vfs->open(path, RETRO_VFS_FILE_ACCESS_READ_WRITE | RETRO_VFS_FILE_ACCESS_UPDATE_EXISTING,
+                             RETRO_VFS_FILE_ACCESS_HINT_NONE);
+  }
+  else
+  {
+    file->fp = fopen(path, "rb+");
+  }
+  if ((file->handle == NULL) && (file->fp == NULL))
+  {
+    free(file);
+    return NULL;
+  }
+  return file;
+}
+
+bool vfs_write(VfsFile *file, long offset, const void *data, long size)
+{
+  if (file->handle != NULL)
+  {
+    return (vfs->seek(file->handle, offset, RETRO_VFS_SEEK_POSITION_START) == offset)
+        && (vfs->write(file->handle, data, size) == size);
+  }
+  return !fseek(file->fp, offset, SEEK_SET) && (fwrite(data, 1, size, file->fp) == (size_t) size);
+}
+
+bool vfs_flush(VfsFile *file)
+{
+  if (file->handle != NULL)
+  {
+    return (vfs->flush(file->handle) == 0);
+  }
+  return (fflush(file->fp) == 0);
+}
+
+void vfs_close(VfsFile *file)
+{
+  if (file->handle != NULL) vfs->close(file->handle);
+  if (file->fp != NULL) fclose(file->fp);
+  free(file);
+}
@@ -0,0 +1,50 @@
+/*
+ * This file is part of theodore, a Thomson emulator
+ * (https://github.com/Zlika/theodore).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Access to the media files, through the VFS interface of the frontend
+ * when it provides one (the C library is used otherwise) */
+
+#ifndef __VFS_H
+#define __VFS_H
+
+#include "boolean.h"
+
+struct retro_vfs_interface;
+
+typedef struct VfsFile VfsFile;
+
+// Sets the VFS interface of the frontend (NULL to use the C library)
+void vfs_init(struct retro_vfs_interface *iface);
+
+// Reads a whole file in a buffer allocated with malloc().
+// Returns NULL in case of error.
+char *vfs_read_file(const char *path, long *size);
+
+// Opens an existing file for writing (without discarding its content).
+// Returns NULL in case of error.
+VfsFile *vfs_open(const char *path);
+// Writes data at a given position of the file.
+// Returns true for success, false for failure.
+bool vfs_write(VfsFile *file, long offset, const void *data, long size);
+// Flushes the pending writes.
+// Returns true for success, false for failure.
+bool vfs_flush(VfsFile *file);
+// Closes the file.
+void vfs_close(VfsFile *file);
+
+#endif /* __VFS_H */